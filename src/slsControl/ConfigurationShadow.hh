@@ -0,0 +1,138 @@
+/*
+ * Copyright (c) European XFEL GmbH Schenefeld. All rights reserved.
+ */
+
+#ifndef KARABO_CONFIGURATIONSHADOW_HH
+#define KARABO_CONFIGURATIONSHADOW_HH
+
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+/**
+ * The main Karabo namespace
+ */
+namespace karabo {
+
+    /**
+     * Shadow of the configuration applied to the detector, for sending only the changed values.
+     *
+     * Commands are in the format "[pos:]command [parameters]": the last value successfully sent is kept for each
+     * "[pos:]command", and the commands are journaled in the order they were applied, for restoring them after a
+     * reconnection. All the methods are thread-safe.
+     */
+    class ConfigurationShadow {
+       public:
+        /**
+         * @param unshadowedCommands commands whose value can change on the detector side, thus always sent
+         */
+        explicit ConfigurationShadow(const std::vector<std::string>& unshadowedCommands)
+            : m_unshadowedCommands(unshadowedCommands){};
+
+        /**
+         * Whether a value is the one last applied.
+         *
+         * @param pos the module, or -1 for all of them. The value sent to all modules is used for a module
+         *            without its own value.
+         */
+        bool isApplied(const std::string& command, const std::string& parameters, int pos) const {
+            if (this->isUnshadowed(command)) {
+                return false;
+            }
+
+            std::scoped_lock lock(m_mutex);
+            if (pos >= 0) {
+                // Module value, or else the one sent to all modules
+                auto it = m_values.find(std::to_string(pos) + ":" + command);
+                if (it != m_values.end()) {
+                    return it->second == parameters;
+                }
+            }
+            auto it = m_values.find(command);
+            return (it != m_values.end() && it->second == parameters);
+        }
+
+        /**
+         * Update the shadow after sending commands.
+         *
+         * @param store whether the values are known to be applied, otherwise they are forgotten
+         * @param numberOfModules for replacing the module values by the one sent to all modules
+         */
+        void update(const std::vector<std::string>& commands, bool store, size_t numberOfModules) {
+            std::scoped_lock lock(m_mutex);
+            for (const std::string& commandAndParameters : commands) {
+                // "[pos:]command [parameters]"
+                const size_t space = commandAndParameters.find(' ');
+                const std::string key = commandAndParameters.substr(0, space);
+                const std::string parameters =
+                      (space == std::string::npos) ? "" : commandAndParameters.substr(space + 1);
+                const size_t colon = key.find(':');
+                const std::string command = (colon == std::string::npos) ? key : key.substr(colon + 1);
+
+                if (command == "settings") {
+                    // The detector reloads its defaults: what was sent before is lost
+                    m_values.clear();
+                }
+
+                // A value for all modules replaces the module ones, and vice versa
+                if (colon == std::string::npos) {
+                    for (size_t i = 0; i < numberOfModules; ++i) {
+                        m_values.erase(std::to_string(i) + ":" + command);
+                    }
+                } else {
+                    m_values.erase(command);
+                }
+
+                // Only the last value of each command is kept for restoring the configuration
+                m_appliedCommands.erase(std::remove_if(m_appliedCommands.begin(), m_appliedCommands.end(),
+                                                       [&key](const std::string& applied) {
+                                                           return applied.substr(0, applied.find(' ')) == key;
+                                                       }),
+                                        m_appliedCommands.end());
+
+                if (store && !this->isUnshadowed(command)) {
+                    m_values[key] = parameters;
+                    m_appliedCommands.push_back(commandAndParameters);
+                } else {
+                    m_values.erase(key);
+                }
+            }
+        }
+
+        // Forget the values applied, such that all of them are sent again
+        void clear() {
+            std::scoped_lock lock(m_mutex);
+            m_values.clear();
+        }
+
+        // The commands applied, in order. Empty if the configuration has to be derived again from the device one.
+        std::vector<std::string> getAppliedCommands() const {
+            std::scoped_lock lock(m_mutex);
+            return m_appliedCommands;
+        }
+
+        void clearAppliedCommands() {
+            std::scoped_lock lock(m_mutex);
+            m_appliedCommands.clear();
+        }
+
+       private:
+        bool isUnshadowed(const std::string& command) const {
+            return std::find(m_unshadowedCommands.begin(), m_unshadowedCommands.end(), command) !=
+                   m_unshadowedCommands.end();
+        }
+
+        const std::vector<std::string> m_unshadowedCommands;
+
+        // Last value successfully sent for each "[pos:]command"
+        std::map<std::string, std::string> m_values;
+        // The same commands, in the order they were applied
+        std::vector<std::string> m_appliedCommands;
+        mutable std::mutex m_mutex;
+    };
+
+} /* namespace karabo */
+
+#endif /* KARABO_CONFIGURATIONSHADOW_HH */
@@ -286,20 +286,16 @@ namespace karabo {
 
         if (configHash.has("reverseSlaveReadOutMode")) {
             const bool& reverseSlaveReadOutMode = configHash.get<bool>("reverseSlaveReadOutMode");
-            std::stringstream ss;
-            if (reverseSlaveReadOutMode) {
-                for (size_t i = 1; i < m_numberOfModules; ++i) {
-                    // 1. Module 0 is the master by default
-                    // 2. Reverse slave read-out mode is the default
-                    ss.str(std::string());
-                    ss << i << ":clearbit";
-                    this->sendConfiguration(ss.str(), "0x20 20");
-                }
-            } else {
-                for (size_t i = 1; i < m_numberOfModules; ++i) {
-                    ss.str(std::string());
-                    ss << i << ":setbit";
-                    this->sendConfiguration(ss.str(), "0x20 20");
+            // 1. Module 0 is the master by default
+            // 2. Reverse slave read-out mode is the default
+            const std::vector<int> slaves(m_positions.begin() + std::min<size_t>(1, m_positions.size()),
+                                          m_positions.end());
+            if (!slaves.empty()) {
+                // A single call: the modules are handled in parallel by sls::Detector
+                if (reverseSlaveReadOutMode) {
+                    m_SLS->clearBit(0x20, 20, slaves);
+                } else {
+                    m_SLS->setBit(0x20, 20, slaves);
                 }
             }
         }
@@ -300,13 +300,21 @@ namespace karabo {
         const slsDetectorDefs::currentSrcParameters par_v1_1(fixCurrent, selectCurrent, normalCurrent); // chipv1.1
         if (m_SLS && !m_SLS->empty()) {
             const std::vector<double> chipVersion = this->get<std::vector<double>>("chipVersion");
+            // One call per chip version, for all the modules with that version
+            std::vector<int> positions_v1_0, positions_v1_1;
             for (int idx : m_positions) {
                 if (std::abs(chipVersion[idx] - 1.0) < 0.01) { // v1.0
-                    m_SLS->setCurrentSource(par_v1_0, {idx});
+                    positions_v1_0.push_back(idx);
                 } else if (std::abs(chipVersion[idx] - 1.1) < 0.01) { // v1.1
-                    m_SLS->setCurrentSource(par_v1_1, {idx});
+                    positions_v1_1.push_back(idx);
                 }
             }
+            if (!positions_v1_0.empty()) {
+                m_SLS->setCurrentSource(par_v1_0, positions_v1_0);
+            }
+            if (!positions_v1_1.empty()) {
+                m_SLS->setCurrentSource(par_v1_1, positions_v1_1);
+            }
             this->set("currentSourceEnabled", true);
         }
     }
@@ -375,14 +383,37 @@ namespace karabo {
             this->set("exposureTimer", exposureTimer); // set read-only device parameter
 
             const uint32_t addr = 0x7F; // ASIC_CTRL register address
-            const std::vector<uint32_t> asicCtrlVector = m_SLS->readRegister(addr);
-
-            int i = 0;
-            for (uint32_t asicCtrl : asicCtrlVector) {
-                // Replace bits 16-31
-                asicCtrl = (asicCtrl & 0xFFFF) | (exposureTimer << 16);
+            const std::vector<uint32_t> asicCtrlVector = m_SLS->readRegister(addr, m_positions);
+
+            // Group the modules by new register value: normally a single call to all of them, as only bits 16-31
+            // are replaced
+            std::map<uint32_t, std::vector<int>> positionsByValue;
+            for (size_t i = 0; i < asicCtrlVector.size(); ++i) {
+                const uint32_t asicCtrl = (asicCtrlVector[i] & 0xFFFF) | (exposureTimer << 16);
+                positionsByValue[asicCtrl].push_back(m_positions[i]);
+            }
 
-                m_SLS->writeRegister(addr, asicCtrl, false, {i++});
+            std::vector<std::string> errors;
+            for (const auto& [asicCtrl, positions] : positionsByValue) {
+                try {
+                    m_SLS->writeRegister(addr, asicCtrl, false, positions);
+                } catch (const std::exception&) {
+                    // Find out which modules failed
+                    for (const int pos : positions) {
+                        try {
+                            m_SLS->writeRegister(addr, asicCtrl, false, {pos});
+                        } catch (const std::exception& e) {
+                            errors.push_back("module " + toString(pos) + ": " + e.what());
+                        }
+                    }
+                }
+            }
+            if (!errors.empty()) {
+                std::string message = "Cannot set the exposure timeout on " + toString(errors.size()) + " module(s)";
+                for (const std::string& error : errors) {
+                    message += "; " + error;
+                }
+                throw KARABO_HARDWARE_EXCEPTION(message);
             }
         }
     }
@@ -0,0 +1,290 @@
+/*
+ * Copyright (c) European XFEL GmbH Schenefeld. All rights reserved.
+ */
+
+#include "ReachabilityProber.hh"
+
+#include <unistd.h>
+
+#include <atomic>
+
+namespace karabo {
+
+    namespace {
+
+        constexpr unsigned char ICMP_ECHO_REPLY = 0;
+        constexpr unsigned char ICMP_ECHO_REQUEST = 8;
+        constexpr size_t ICMP_HEADER_SIZE = 8;
+
+        // Internet checksum (RFC 1071)
+        unsigned short icmpChecksum(const unsigned char* data, size_t size) {
+            unsigned int sum = 0;
+            for (size_t i = 0; i + 1 < size; i += 2) {
+                sum += (data[i] << 8) | data[i + 1];
+            }
+            if (size % 2 == 1) {
+                sum += data[size - 1] << 8;
+            }
+            while (sum >> 16) {
+                sum = (sum & 0xFFFF) + (sum >> 16);
+            }
+            return ~sum & 0xFFFF;
+        }
+
+    } // namespace
+
+    ReachabilityProber::ReachabilityProber(double ttl, unsigned int timeout)
+        : m_work(boost::asio::make_work_guard(m_ioContext)),
+          m_timeout(timeout),
+          m_sequence(0) {
+        this->setTtl(ttl);
+
+        // Echo replies are delivered to all raw ICMP sockets: distinguish the probers in the same process
+        static std::atomic<unsigned short> instances(0);
+        m_identifier = (getpid() + instances++) & 0xFFFF;
+
+        try {
+            m_icmpSocket = std::make_unique<boost::asio::ip::icmp::socket>(m_ioContext, boost::asio::ip::icmp::v4());
+            this->receiveIcmp();
+        } catch (const boost::system::system_error&) {
+            // Raw sockets need CAP_NET_RAW: fall back to TCP probes
+            m_icmpSocket.reset();
+        }
+
+        m_thread = std::thread([this]() { m_ioContext.run(); });
+    }
+
+    ReachabilityProber::~ReachabilityProber() {
+        m_work.reset();
+        m_ioContext.stop();
+        if (m_thread.joinable()) {
+            m_thread.join();
+        }
+    }
+
+    std::string ReachabilityProber::getMethod() const {
+        return m_icmpSocket ? "icmp" : "tcp";
+    }
+
+    void ReachabilityProber::setTtl(double ttl) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_ttl = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(ttl));
+    }
+
+    std::vector<ReachabilityProber::Reachability> ReachabilityProber::getReachability(
+          const std::vector<Target>& targets) {
+        std::vector<Reachability> results;
+        std::vector<std::pair<Target, unsigned int>> probes;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            probes = this->startProbes(targets);
+            for (const Target& target : targets) {
+                results.push_back(m_entries[this->getKey(target)].reachability);
+            }
+        }
+        this->postProbes(probes);
+        return results;
+    }
+
+    std::vector<bool> ReachabilityProber::probe(const std::vector<Target>& targets) {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        const std::vector<std::pair<Target, unsigned int>> probes = this->startProbes(targets);
+        lock.unlock();
+        this->postProbes(probes);
+        lock.lock();
+
+        // The timeout of each probe is handled in m_thread, this is only a safeguard
+        const auto deadline = std::chrono::steady_clock::now() + m_timeout + std::chrono::seconds(1);
+        m_resultReady.wait_until(lock, deadline, [this, &targets]() {
+            for (const Target& target : targets) {
+                if (m_entries[this->getKey(target)].pending) {
+                    return false;
+                }
+            }
+            return true;
+        });
+
+        std::vector<bool> results;
+        for (const Target& target : targets) {
+            results.push_back(m_entries[this->getKey(target)].reachability == Reachability::reachable);
+        }
+        return results;
+    }
+
+    void ReachabilityProber::clear() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& item : m_entries) {
+            // Pending probes will be ignored
+            Entry& entry = item.second;
+            entry.reachability = Reachability::unknown;
+            entry.pending = false;
+            entry.probeId += 1;
+        }
+    }
+
+    std::string ReachabilityProber::getKey(const Target& target) const {
+        // ICMP probes the host, TCP a port on the host
+        return m_icmpSocket ? target.host : target.host + ":" + std::to_string(target.port);
+    }
+
+    std::vector<std::pair<ReachabilityProber::Target, unsigned int>> ReachabilityProber::startProbes(
+          const std::vector<Target>& targets) {
+        std::vector<std::pair<Target, unsigned int>> probes;
+        const auto now = std::chrono::steady_clock::now();
+        for (const Target& target : targets) {
+            Entry& entry = m_entries[this->getKey(target)];
+            if (entry.pending || (entry.reachability != Reachability::unknown && now - entry.time < m_ttl)) {
+                continue; // Probe in progress, or fresh result
+            }
+            entry.pending = true;
+            entry.probeId += 1;
+            probes.push_back({target, entry.probeId});
+        }
+        return probes;
+    }
+
+    void ReachabilityProber::postProbes(const std::vector<std::pair<Target, unsigned int>>& probes) {
+        for (const auto& probe : probes) {
+            boost::asio::post(m_ioContext, [this, probe]() {
+                if (m_icmpSocket) {
+                    this->probeIcmp(probe.first, probe.second);
+                } else {
+                    this->probeTcp(probe.first, probe.second);
+                }
+            });
+        }
+    }
+
+    void ReachabilityProber::probeIcmp(const Target& target, unsigned int probeId) {
+        using boost::asio::ip::icmp;
+
+        const std::string key = this->getKey(target);
+        auto resolver = std::make_shared<icmp::resolver>(m_ioContext);
+        resolver->async_resolve(
+              icmp::v4(), target.host, "",
+              [this, key, probeId, resolver](const boost::system::error_code& ec,
+                                             icmp::resolver::results_type results) {
+                  if (ec || results.empty()) {
+                      this->setResult(key, probeId, false);
+                      return;
+                  }
+
+                  // Echo request: type, code, checksum, identifier, sequence number
+                  const unsigned short sequence = ++m_sequence;
+                  auto request = std::make_shared<std::array<unsigned char, ICMP_HEADER_SIZE>>();
+                  *request = {ICMP_ECHO_REQUEST,
+                              0,
+                              0,
+                              0,
+                              static_cast<unsigned char>(m_identifier >> 8),
+                              static_cast<unsigned char>(m_identifier & 0xFF),
+                              static_cast<unsigned char>(sequence >> 8),
+                              static_cast<unsigned char>(sequence & 0xFF)};
+                  const unsigned short checksum = icmpChecksum(request->data(), request->size());
+                  (*request)[2] = checksum >> 8;
+                  (*request)[3] = checksum & 0xFF;
+
+                  auto timer = std::make_shared<boost::asio::steady_timer>(m_ioContext, m_timeout);
+                  m_echos[sequence] = Echo{key, probeId, timer};
+                  timer->async_wait([this, sequence](const boost::system::error_code& ec) {
+                      auto it = m_echos.find(sequence);
+                      if (!ec && it != m_echos.end()) {
+                          // No reply
+                          this->setResult(it->second.key, it->second.probeId, false);
+                          m_echos.erase(it);
+                      }
+                  });
+
+                  m_icmpSocket->async_send_to(boost::asio::buffer(*request), *results.begin(),
+                                              [this, sequence, request](const boost::system::error_code& ec, size_t) {
+                                                  auto it = m_echos.find(sequence);
+                                                  if (ec && it != m_echos.end()) {
+                                                      it->second.timer->cancel();
+                                                      this->setResult(it->second.key, it->second.probeId, false);
+                                                      m_echos.erase(it);
+                                                  }
+                                              });
+              });
+    }
+
+    void ReachabilityProber::receiveIcmp() {
+        m_icmpSocket->async_receive_from(
+              boost::asio::buffer(m_icmpBuffer), m_icmpSender,
+              [this](const boost::system::error_code& ec, size_t size) {
+                  if (ec == boost::asio::error::operation_aborted) {
+                      return;
+                  }
+
+                  // Raw sockets receive the IPv4 header as well
+                  const size_t ipHeaderSize = (size > 0) ? (m_icmpBuffer[0] & 0x0F) * 4 : 0;
+                  if (!ec && size >= ipHeaderSize + ICMP_HEADER_SIZE) {
+                      const unsigned char* icmpHeader = m_icmpBuffer.data() + ipHeaderSize;
+                      const unsigned short identifier = (icmpHeader[4] << 8) | icmpHeader[5];
+                      const unsigned short sequence = (icmpHeader[6] << 8) | icmpHeader[7];
+                      auto it = m_echos.find(sequence);
+                      if (icmpHeader[0] == ICMP_ECHO_REPLY && identifier == m_identifier && it != m_echos.end()) {
+                          it->second.timer->cancel();
+                          this->setResult(it->second.key, it->second.probeId, true);
+                          m_echos.erase(it);
+                      }
+                  }
+
+                  this->receiveIcmp();
+              });
+    }
+
+    void ReachabilityProber::probeTcp(const Target& target, unsigned int probeId) {
+        using boost::asio::ip::tcp;
+
+        const std::string key = this->getKey(target);
+        auto resolver = std::make_shared<tcp::resolver>(m_ioContext);
+        auto socket = std::make_shared<tcp::socket>(m_ioContext);
+        auto timer = std::make_shared<boost::asio::steady_timer>(m_ioContext, m_timeout);
+
+        timer->async_wait([this, key, probeId, resolver, socket](const boost::system::error_code& ec) {
+            if (!ec) {
+                // No answer: abort resolution or connection
+                resolver->cancel();
+                boost::system::error_code ignored;
+                socket->close(ignored);
+                this->setResult(key, probeId, false);
+            }
+        });
+
+        resolver->async_resolve(
+              target.host, std::to_string(target.port),
+              [this, key, probeId, resolver, socket, timer](const boost::system::error_code& ec,
+                                                            tcp::resolver::results_type results) {
+                  if (ec) {
+                      timer->cancel();
+                      this->setResult(key, probeId, false);
+                      return;
+                  }
+
+                  boost::asio::async_connect(
+                        *socket, results,
+                        [this, key, probeId, socket, timer](const boost::system::error_code& ec, const tcp::endpoint&) {
+                            timer->cancel();
+                            // A refused connection comes from the host itself
+                            this->setResult(key, probeId, !ec || ec == boost::asio::error::connection_refused);
+                            boost::system::error_code ignored;
+                            socket->close(ignored);
+                        });
+              });
+    }
+
+    void ReachabilityProber::setResult(const std::string& key, unsigned int probeId, bool reachable) {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            Entry& entry = m_entries[key];
+            if (!entry.pending || entry.probeId != probeId) {
+                return; // Already timed out, or cleared
+            }
+            entry.pending = false;
+            entry.reachability = reachable ? Reachability::reachable : Reachability::unreachable;
+            entry.time = std::chrono::steady_clock::now();
+        }
+        m_resultReady.notify_all();
+    }
+
+} /* namespace karabo */
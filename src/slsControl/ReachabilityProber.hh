@@ -0,0 +1,120 @@
+/*
+ * Copyright (c) European XFEL GmbH Schenefeld. All rights reserved.
+ */
+
+#ifndef KARABO_REACHABILITYPROBER_HH
+#define KARABO_REACHABILITYPROBER_HH
+
+#include <array>
+#include <boost/asio.hpp>
+#include <chrono>
+#include <condition_variable>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * The main Karabo namespace
+ */
+namespace karabo {
+
+    /**
+     * Checks whether hosts are reachable, without spawning processes and without blocking on each host in turn.
+     *
+     * Hosts are probed with an ICMP echo request if raw sockets are allowed (CAP_NET_RAW), otherwise by
+     * connecting to a TCP port (a refused connection still means that the host is reachable). All the probes
+     * run concurrently in a dedicated thread, and their results are cached for a given time.
+     */
+    class ReachabilityProber {
+       public:
+        enum class Reachability { unknown, reachable, unreachable };
+
+        struct Target {
+            std::string host;
+            unsigned short port; // Only used for TCP probes
+        };
+
+        /**
+         * @param ttl how long a result is valid [s]
+         * @param timeout how long to wait for a reply [ms]
+         */
+        ReachabilityProber(double ttl, unsigned int timeout);
+
+        ~ReachabilityProber();
+
+        // "icmp" or "tcp"
+        std::string getMethod() const;
+
+        void setTtl(double ttl);
+
+        /**
+         * Non-blocking: return the cached results, and start a new probe for the targets whose result is missing
+         * or expired. Results are unknown until the first probe completes.
+         */
+        std::vector<Reachability> getReachability(const std::vector<Target>& targets);
+
+        /**
+         * Blocking: probe the targets whose result is missing or expired, and wait for all of them. As the probes
+         * are concurrent, this takes at most the timeout.
+         *
+         * @return true for the reachable targets
+         */
+        std::vector<bool> probe(const std::vector<Target>& targets);
+
+        // Forget the cached results
+        void clear();
+
+       private:
+        struct Entry {
+            Entry() : reachability(Reachability::unknown), pending(false), probeId(0){};
+
+            Reachability reachability;
+            bool pending;
+            unsigned int probeId; // Results of older probes are discarded
+            std::chrono::steady_clock::time_point time;
+        };
+
+        struct Echo {
+            std::string key;
+            unsigned int probeId;
+            std::shared_ptr<boost::asio::steady_timer> timer;
+        };
+
+        std::string getKey(const Target& target) const;
+
+        // Mark the expired targets as pending, to be called with m_mutex locked
+        std::vector<std::pair<Target, unsigned int>> startProbes(const std::vector<Target>& targets);
+        void postProbes(const std::vector<std::pair<Target, unsigned int>>& probes);
+
+        // The following functions are only executed in m_thread
+        void probeIcmp(const Target& target, unsigned int probeId);
+        void probeTcp(const Target& target, unsigned int probeId);
+        void receiveIcmp();
+        void setResult(const std::string& key, unsigned int probeId, bool reachable);
+
+        boost::asio::io_context m_ioContext;
+        boost::asio::executor_work_guard<boost::asio::io_context::executor_type> m_work;
+        std::unique_ptr<boost::asio::ip::icmp::socket> m_icmpSocket; // Null if raw sockets are not allowed
+        std::thread m_thread;
+
+        std::chrono::steady_clock::duration m_ttl;
+        const std::chrono::milliseconds m_timeout;
+
+        mutable std::mutex m_mutex;
+        std::condition_variable m_resultReady;
+        std::map<std::string, Entry> m_entries;
+
+        // Outstanding ICMP echo requests, by sequence number
+        unsigned short m_identifier;
+        unsigned short m_sequence;
+        std::map<unsigned short, Echo> m_echos;
+        std::array<unsigned char, 1500> m_icmpBuffer;
+        boost::asio::ip::icmp::endpoint m_icmpSender;
+    };
+
+} /* namespace karabo */
+
+#endif /* KARABO_REACHABILITYPROBER_HH */
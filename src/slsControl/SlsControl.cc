@@ -21,22 +21,51 @@ namespace karabo {
     const std::vector<slsDetectorDefs::runStatus> idleStates = {
           slsDetectorDefs::runStatus::IDLE, slsDetectorDefs::runStatus::ERROR, slsDetectorDefs::runStatus::STOPPED};
 
+    // Commands whose value can change on the detector side (e.g. after each acquisition), thus always sent
+    const std::vector<std::string> unshadowedCommands = {"findex"};
+
+    // Check of the acquisition status after start [ms]
+    const unsigned int startCheckFirstDelay = 2;
+    const unsigned int startCheckMaxDelay = 100;
+    const unsigned int startTimeout = 2000;
+
+    // How long the status is polled fast after a state transition [ms]
+    const unsigned int statusTransitionWindow = 5000;
+
+    // Delay before the second reconnection attempt, then doubled up to 'reconnectMaxInterval' [ms]
+    const unsigned int reconnectFirstDelay = 250;
+
     SlsControl::SlsControl(const Hash& config)
         : Device(config),
           m_numberOfModules(0),
           m_connect(false),
           m_connect_timer(EventLoop::getIOService()),
+          m_reconnectAttempts(0),
+          m_random(std::random_device()()),
+          m_recovering(false),
           m_isConfigured(false),
           m_firstPoll(true),
           m_poll(false),
           m_status_timer(EventLoop::getIOService()),
           m_poll_timer(EventLoop::getIOService()),
-          m_acquireForever(false) {
+          m_statusPollTimeMax(0.f),
+          m_statusPollOverruns(0),
+          m_hardwarePollOverruns(0),
+          m_strand(std::make_shared<karabo::net::Strand>(EventLoop::getIOService())),
+          m_acquisition_timer(EventLoop::getIOService()),
+          m_starting(false),
+          m_startCheckDelay(startCheckFirstDelay),
+          m_expectedDuration(0.f),
+          m_restartCount(0),
+          m_acquireForever(false),
+          m_prober(std::make_unique<ReachabilityProber>(config.get<float>("reachabilityTtl"), 2000)),
+          m_shadow(unshadowedCommands) {
         KARABO_INITIAL_FUNCTION(initialize);
 
         KARABO_SLOT(start);
         KARABO_SLOT(stop);
         KARABO_SLOT(reset);
+        KARABO_SLOT(resendConfiguration);
 
         this->createTmpDir(); // Create temporary directory
     }
@@ -80,6 +109,15 @@ namespace karabo {
               .allowedStates(State::ERROR)
               .commit();
 
+        SLOT_ELEMENT(expected)
+              .key("resendConfiguration")
+              .displayedName("Resend Configuration")
+              .description(
+                    "Send again the whole configuration to the detector. Otherwise, only the values differing from "
+                    "the ones last sent are.")
+              .allowedStates(State::ON)
+              .commit();
+
         VECTOR_STRING_ELEMENT(expected)
               .key("detectorHostName")
               .alias("hostname")
@@ -380,6 +418,42 @@ namespace karabo {
               .allowedStates(State::ON)
               .commit();
 
+        UINT32_ELEMENT(expected)
+              .key("restartWatchInterval")
+              .displayedName("Restart Watch Interval")
+              .description(
+                    "In continuous mode, the interval for checking whether the acquisition is over, and "
+                    "restarting it. It is only used close to the end expected from the number of frames and "
+                    "triggers, the status is watched at 'statusPollingFast' otherwise.")
+              .assignmentOptional()
+              .defaultValue(50)
+              .unit(Unit::SECOND)
+              .metricPrefix(MetricPrefix::MILLI)
+              .minInc(10)
+              .maxInc(1000)
+              .reconfigurable()
+              .commit();
+
+        FLOAT_ELEMENT(expected)
+              .key("restartGap")
+              .displayedName("Restart Gap")
+              .description(
+                    "In continuous mode, the time between the detector last seen acquiring and its restart. "
+                    "This is an upper limit of the time without acquisition.")
+              .unit(Unit::SECOND)
+              .metricPrefix(MetricPrefix::MILLI)
+              .readOnly()
+              .initialValue(0.f)
+              .commit();
+
+        UINT32_ELEMENT(expected)
+              .key("restartCount")
+              .displayedName("Restart Count")
+              .description("In continuous mode, the number of restarts since the acquisition was started.")
+              .readOnly()
+              .initialValue(0)
+              .commit();
+
         // Mythen3 only
         //        INT64_ELEMENT(expected).key("numberOfGates")
         //                .alias("gates")
@@ -491,9 +565,9 @@ namespace karabo {
               .key("pollingInterval")
               .displayedName("Polling Interval")
               .description(
-                    "The interval for polling the detector module for status. This "
-                    "interval also determines the maximum time needed to indicate that a detector "
-                    "module is offline or not reachable anymore.")
+                    "The interval for polling the detector modules for temperatures and other slowly changing "
+                    "parameters. The acquisition status is polled at 'statusPollingFast' and "
+                    "'statusPollingSlow'.")
               .assignmentOptional()
               .defaultValue(10)
               .unit(Unit::SECOND)
@@ -501,21 +575,237 @@ namespace karabo {
               .maxInc(600)
               .reconfigurable()
               .commit();
+
+        UINT32_ELEMENT(expected)
+              .key("statusPollingFast")
+              .displayedName("Status Polling Fast")
+              .description(
+                    "The interval for polling the detector modules for status, while acquiring and shortly after "
+                    "a state transition.")
+              .assignmentOptional()
+              .defaultValue(100)
+              .unit(Unit::SECOND)
+              .metricPrefix(MetricPrefix::MILLI)
+              .minInc(10)
+              .maxInc(1000)
+              .reconfigurable()
+              .commit();
+
+        UINT32_ELEMENT(expected)
+              .key("statusPollingSlow")
+              .displayedName("Status Polling Slow")
+              .description(
+                    "The interval for polling the detector modules for status, otherwise. This interval also "
+                    "determines the maximum time needed to indicate that a detector module is offline or not "
+                    "reachable anymore.")
+              .assignmentOptional()
+              .defaultValue(1000)
+              .unit(Unit::SECOND)
+              .metricPrefix(MetricPrefix::MILLI)
+              .minInc(100)
+              .maxInc(10000)
+              .reconfigurable()
+              .commit();
+
+        UINT32_ELEMENT(expected)
+              .key("statusPollingBudget")
+              .displayedName("Status Polling Budget")
+              .description("A status poll taking longer is counted as overrun.")
+              .assignmentOptional()
+              .defaultValue(50)
+              .unit(Unit::SECOND)
+              .metricPrefix(MetricPrefix::MILLI)
+              .reconfigurable()
+              .expertAccess()
+              .commit();
+
+        UINT32_ELEMENT(expected)
+              .key("hardwarePollingBudget")
+              .displayedName("Hardware Polling Budget")
+              .description("A poll of the temperatures and other parameters taking longer is counted as overrun.")
+              .assignmentOptional()
+              .defaultValue(1000)
+              .unit(Unit::SECOND)
+              .metricPrefix(MetricPrefix::MILLI)
+              .reconfigurable()
+              .expertAccess()
+              .commit();
+
+        FLOAT_ELEMENT(expected)
+              .key("statusPollTime")
+              .displayedName("Status Poll Time")
+              .description("The longest status poll in the last second.")
+              .unit(Unit::SECOND)
+              .metricPrefix(MetricPrefix::MILLI)
+              .readOnly()
+              .initialValue(0.f)
+              .commit();
+
+        FLOAT_ELEMENT(expected)
+              .key("hardwarePollTime")
+              .displayedName("Hardware Poll Time")
+              .description("The duration of the last poll of the temperatures and other parameters.")
+              .unit(Unit::SECOND)
+              .metricPrefix(MetricPrefix::MILLI)
+              .readOnly()
+              .initialValue(0.f)
+              .commit();
+
+        UINT32_ELEMENT(expected)
+              .key("statusPollOverruns")
+              .displayedName("Status Poll Overruns")
+              .description("The number of status polls over budget.")
+              .readOnly()
+              .initialValue(0)
+              .commit();
+
+        UINT32_ELEMENT(expected)
+              .key("hardwarePollOverruns")
+              .displayedName("Hardware Poll Overruns")
+              .description("The number of polls of the temperatures and other parameters over budget.")
+              .readOnly()
+              .initialValue(0)
+              .commit();
+
+        FLOAT_ELEMENT(expected)
+              .key("reachabilityTtl")
+              .displayedName("Reachability TTL")
+              .description(
+                    "How long the result of a reachability check of detector and receiver hosts is reused, "
+                    "before probing them again.")
+              .assignmentOptional()
+              .defaultValue(1.f)
+              .unit(Unit::SECOND)
+              .minInc(0.1f)
+              .maxInc(60.f)
+              .reconfigurable()
+              .commit();
+
+        STRING_ELEMENT(expected)
+              .key("reachabilityMethod")
+              .displayedName("Reachability Method")
+              .description(
+                    "How hosts are probed: ICMP echo if raw sockets are allowed, otherwise TCP connection to the "
+                    "control port of the detector and to the TCP port of the receiver.")
+              .readOnly()
+              .commit();
+
+        VECTOR_BOOL_ELEMENT(expected)
+              .key("detectorReachable")
+              .displayedName("Detector Reachable")
+              .description("Whether each detector module is reachable.")
+              .readOnly()
+              .commit();
+
+        VECTOR_BOOL_ELEMENT(expected)
+              .key("rxReachable")
+              .displayedName("RX Reachable")
+              .description("Whether each receiver host is reachable.")
+              .readOnly()
+              .commit();
+
+        UINT32_ELEMENT(expected)
+              .key("reconnectMaxInterval")
+              .displayedName("Reconnect Max Interval")
+              .description(
+                    "After the connection is lost, the first reconnection attempt is immediate, and the "
+                    "following ones are made with an exponentially increasing interval, up to this value.")
+              .assignmentOptional()
+              .defaultValue(5000)
+              .unit(Unit::SECOND)
+              .metricPrefix(MetricPrefix::MILLI)
+              .minInc(reconnectFirstDelay)
+              .maxInc(60000)
+              .reconfigurable()
+              .commit();
+
+        FLOAT_ELEMENT(expected)
+              .key("timeToRecover")
+              .displayedName("Time to Recover")
+              .description("The time between the last loss of connection and the detector being back online.")
+              .unit(Unit::SECOND)
+              .readOnly()
+              .initialValue(0.f)
+              .commit();
+
+        FLOAT_ELEMENT(expected)
+              .key("startLatency")
+              .displayedName("Start Latency")
+              .description("The time between the start of the acquisition and the detector leaving the idle state.")
+              .unit(Unit::SECOND)
+              .metricPrefix(MetricPrefix::MILLI)
+              .readOnly()
+              .initialValue(0.f)
+              .commit();
     }
 
     void SlsControl::start() {
-        // If the 'start' slot is called while 'pollStatus' is also running, the acquisition might
-        // be stopped immediately.
-        std::scoped_lock lock(m_status_mtx);
+        {
+            // 'pollStatus' must not take the still idle detector for a finished acquisition
+            std::scoped_lock lock(m_status_mtx);
+            m_starting = true;
+        }
 
-        this->updateState(State::ACQUIRING, Hash("status", "Acquisition started"));
+        m_restartCount = 0;
+        this->updateState(State::ACQUIRING, Hash("status", "Acquisition started", "restartCount", m_restartCount));
         m_acquireForever = this->get<bool>("continuousMode");
-        m_SLS->startReceiver();
-        m_SLS->startDetector();
+        m_strand->post(karabo::util::bind_weak(&SlsControl::startAcquisition, this));
+    }
+
+    void SlsControl::stop() {
+        KARABO_LOG_FRAMEWORK_DEBUG << "In stop";
+        m_acquireForever = false;
+
+        KARABO_LOG_INFO << "Stopping acquisition";
+        this->set("status", "Stopping acquisition");
+        m_strand->post(karabo::util::bind_weak(&SlsControl::stopAcquisition, this));
+
+        KARABO_LOG_FRAMEWORK_DEBUG << "Quitting stop";
+    }
+
+    void SlsControl::startAcquisition() {
+        std::scoped_lock lock(m_status_mtx);
+        if (!m_starting) {
+            return; // Stopped in the meantime
+        }
+
+        try {
+            m_expectedDuration = this->getExpectedDuration();
+            m_startTime = std::chrono::steady_clock::now();
+            m_SLS->startReceiver();
+            m_SLS->startDetector();
+        } catch (const std::exception& e) {
+            m_starting = false;
+            this->updateState(State::ERROR, Hash("status", e.what()));
+            KARABO_LOG_FRAMEWORK_ERROR << "Exception in 'start': " << e.what();
+            return;
+        }
+
+        m_startCheckDelay = startCheckFirstDelay;
+        this->scheduleAcquisitionCheck(m_startCheckDelay);
+    }
+
+    void SlsControl::scheduleAcquisitionCheck(unsigned int delay) {
+        m_acquisition_timer.expires_from_now(boost::posix_time::milliseconds(delay));
+        m_acquisition_timer.async_wait(
+              karabo::util::bind_weak(&SlsControl::onAcquisitionTimer, this, boost::asio::placeholders::error));
+    }
+
+    void SlsControl::onAcquisitionTimer(const boost::system::error_code& ec) {
+        if (ec) {
+            return;
+        }
+        m_strand->post(karabo::util::bind_weak(&SlsControl::checkAcquisitionStatus, this));
+    }
+
+    void SlsControl::checkAcquisitionStatus() {
+        std::scoped_lock lock(m_status_mtx);
+        if (!m_starting && !m_acquireForever) {
+            return; // Stopped in the meantime, or nothing to watch
+        }
+
         bool is_acquiring = false;
-        int attempts = 10;
-        while (!is_acquiring && attempts > 0) {
-            std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        try {
             const std::vector<slsDetectorDefs::runStatus> status = m_SLS->getDetectorStatus();
             for (const slsDetectorDefs::runStatus st : status) {
                 if (std::find(idleStates.begin(), idleStates.end(), st) == idleStates.end()) {
@@ -524,25 +814,111 @@ namespace karabo {
                     break;
                 }
             }
-            attempts--;
+        } catch (const std::exception& e) {
+            // 'pollStatus' will handle the error
+            KARABO_LOG_FRAMEWORK_WARN << "Exception in 'checkAcquisitionStatus': " << e.what();
+            m_starting = false;
+            return;
         }
-        if (attempts < 10) {
-            KARABO_LOG_FRAMEWORK_WARN << "Acquisition started after " << 10 - attempts << " attempts";
-        } else  if (attempts <= 0) {
-            KARABO_LOG_FRAMEWORK_ERROR << "Status is still idle after check 10 attempts";
+
+        const auto now = std::chrono::steady_clock::now();
+        if (!m_starting) {
+            // Continuous mode: restart at once if the acquisition is over
+            if (is_acquiring) {
+                m_lastAcquiringTime = now;
+            } else if (this->getState() == State::ACQUIRING) {
+                try {
+                    this->restartAcquisition();
+                } catch (const std::exception& e) {
+                    // 'pollStatus' will handle the error
+                    KARABO_LOG_FRAMEWORK_WARN << "Exception in 'restartAcquisition': " << e.what();
+                }
+                return;
+            }
+            this->scheduleAcquisitionCheck(this->getRestartWatchDelay(now));
+            return;
+        }
+
+        const float elapsed = std::chrono::duration<float, std::milli>(now - m_startTime).count();
+        if (is_acquiring) {
+            m_starting = false;
+            m_lastAcquiringTime = now;
+            this->set("startLatency", elapsed);
+            KARABO_LOG_FRAMEWORK_DEBUG << "Acquisition started after " << elapsed << " ms";
+            if (m_acquireForever) {
+                this->scheduleAcquisitionCheck(this->getRestartWatchDelay(now));
+            }
+        } else if (elapsed >= startTimeout) {
+            // 'pollStatus' will take the acquisition as finished
+            m_starting = false;
+            KARABO_LOG_FRAMEWORK_ERROR << "Status is still idle " << elapsed << " ms after start";
+        } else {
+            m_startCheckDelay = std::min(2 * m_startCheckDelay, startCheckMaxDelay);
+            this->scheduleAcquisitionCheck(m_startCheckDelay);
         }
     }
 
-    void SlsControl::stop() {
-        KARABO_LOG_FRAMEWORK_DEBUG << "In stop";
-        m_acquireForever = false;
+    float SlsControl::getExpectedDuration() {
+        try {
+            const std::string timing = this->get<std::string>("timing");
+            const long long frames = this->get<long long>("numberOfFrames");
+            const long long triggers = this->get<long long>("numberOfTriggers");
+            const float framePeriod =
+                  std::max(this->get<float>("exposureTime"), this->get<float>("exposurePeriod")); // [s]
+            if (timing == "auto") {
+                return 1000.f * frames * triggers * framePeriod;
+            } else if (timing == "trigger") {
+                // The external trigger period is only known from the device configuration
+                return 1000.f * triggers * std::max(this->get<float>("triggerPeriod"), frames * framePeriod);
+            }
+        } catch (const std::exception&) {
+            // Not configured
+        }
+        return 0.f;
+    }
 
-        KARABO_LOG_INFO << "Stopping acquisition";
-        this->set("status", "Stopping acquisition");
-        m_SLS->stopDetector();
-        m_SLS->stopReceiver();
+    unsigned int SlsControl::getRestartWatchDelay(const std::chrono::steady_clock::time_point& now) {
+        const unsigned int watchInterval = this->get<unsigned int>("restartWatchInterval");
+        const unsigned int normalInterval = std::max(this->get<unsigned int>("statusPollingFast"), watchInterval);
+        if (m_expectedDuration <= 0.f) {
+            return normalInterval;
+        }
 
-        KARABO_LOG_FRAMEWORK_DEBUG << "Quitting stop";
+        // Fast from one normal interval before the expected end
+        const float elapsed = std::chrono::duration<float, std::milli>(now - m_startTime).count();
+        const float untilFastWatch = m_expectedDuration - normalInterval - elapsed;
+        if (untilFastWatch <= watchInterval) {
+            return watchInterval;
+        }
+        return std::min(static_cast<unsigned int>(untilFastWatch), normalInterval);
+    }
+
+    void SlsControl::restartAcquisition() {
+        KARABO_LOG_FRAMEWORK_DEBUG << "Restarting acquisition";
+        m_SLS->startDetector();
+
+        // Until the detector is seen acquiring again, the restart is handled as a start
+        m_startTime = std::chrono::steady_clock::now();
+        m_starting = true;
+        m_startCheckDelay = startCheckFirstDelay;
+        this->scheduleAcquisitionCheck(m_startCheckDelay);
+
+        const float gap = std::chrono::duration<float, std::milli>(m_startTime - m_lastAcquiringTime).count();
+        this->set(Hash("restartGap", gap, "restartCount", ++m_restartCount));
+    }
+
+    void SlsControl::stopAcquisition() {
+        std::scoped_lock lock(m_status_mtx);
+        m_starting = false;
+        m_acquisition_timer.cancel();
+
+        try {
+            m_SLS->stopDetector();
+            m_SLS->stopReceiver();
+        } catch (const std::exception& e) {
+            this->set("status", e.what());
+            KARABO_LOG_FRAMEWORK_ERROR << "Exception in 'stop': " << e.what();
+        }
     }
 
     void SlsControl::reset() {
@@ -551,6 +927,8 @@ namespace karabo {
             KARABO_LOG_INFO << "Initializing detector(s)";
 
             m_isConfigured = false;
+            // Derive again the whole configuration
+            m_shadow.clearAppliedCommands();
             this->sendBaseConfiguration();
             this->sendInitialConfiguration();
             const Hash& config = this->getCurrentConfiguration();
@@ -563,7 +941,22 @@ namespace karabo {
         }
     }
 
+    void SlsControl::resendConfiguration() {
+        try {
+            m_shadow.clear();
+            m_shadow.clearAppliedCommands();
+            this->sendInitialConfiguration();
+            const Hash& config = this->getCurrentConfiguration();
+            this->configureDetectorSpecific(config);
+        } catch (const std::exception& e) {
+            this->updateState(State::ERROR, Hash("status", e.what()));
+            KARABO_LOG_FRAMEWORK_ERROR << "Exception in 'resendConfiguration': " << e.what();
+        }
+    }
+
     void SlsControl::initialize() {
+        this->buildKeyTable();
+
         try {
             m_numberOfModules = this->get<std::vector<std::string>>("detectorHostName").size();
             m_positions.resize(m_numberOfModules);
@@ -605,26 +998,30 @@ namespace karabo {
         bool detectorOnline = false;
 
         try {
-            std::vector<std::string> hosts = this->get<std::vector<std::string>>("detectorHostName");
-            for (const std::string& hostname : hosts) {
-                // Verify that the detector is online
-                if (!this->ping(hostname)) {
-                    throw std::runtime_error(hostname + " is not pingable");
-                }
+            // Verify that the detectors are online
+            std::vector<std::string> unreachable = this->getUnreachableHosts(HostType::detector, true);
+            if (!unreachable.empty()) {
+                throw std::runtime_error(unreachable.front() + " is not reachable");
             }
 
             // Verify that the detector server(s) is (are) running
-            m_SLS->setHostname(hosts);
+            std::vector<std::string> hosts = this->get<std::vector<std::string>>("detectorHostName");
+            if (hosts != m_appliedHostnames) {
+                // This frees and reallocates the SLS shared memory: only when the hostnames change
+                m_SLS->setHostname(hosts);
+                m_appliedHostnames = hosts;
+            } else {
+                m_SLS->getDetectorStatus();
+            }
             detectorOnline = true;
 
             hosts = this->get<std::vector<std::string>>("rxHostname");
             const std::vector<unsigned short> ports = this->get<std::vector<unsigned short>>("rxTcpPort");
 
-            for (const std::string& hostname : hosts) {
-                // Verify that the receiver host is online
-                if (!this->ping(hostname)) {
-                    throw std::runtime_error(hostname + " is not pingable");
-                }
+            // Verify that the receiver hosts are online
+            unreachable = this->getUnreachableHosts(HostType::receiver, true);
+            if (!unreachable.empty()) {
+                throw std::runtime_error(unreachable.front() + " is not reachable");
             }
 
             for (size_t idx = 0; idx < ports.size(); ++idx) {
@@ -638,13 +1035,24 @@ namespace karabo {
             KARABO_LOG_INFO << "Initializing detector(s)";
 
             this->sendBaseConfiguration();
-            this->sendInitialConfiguration();
+            if (!this->restoreConfiguration()) {
+                this->sendInitialConfiguration();
+            }
             const Hash& config = this->getCurrentConfiguration();
             this->configureDetectorSpecific(config);
 #ifdef SLS_SIMULATION
             m_SLS->setDetectorType(m_detectorType);
 #endif
             this->updateState(State::ON, Hash("status", "Connected to detector(s)"));
+            m_reconnectAttempts = 0;
+
+            if (m_recovering) {
+                m_recovering = false;
+                const float timeToRecover =
+                      std::chrono::duration<float>(std::chrono::steady_clock::now() - m_disconnectTime).count();
+                this->set("timeToRecover", timeToRecover);
+                KARABO_LOG_FRAMEWORK_INFO << "Connection recovered after " << timeToRecover << " s";
+            }
 
         } catch (const std::exception& e) {
             if (this->get<std::string>("status") != e.what()) {
@@ -658,10 +1066,7 @@ namespace karabo {
                 }
 
                 if (m_connect) {
-                    m_connect_timer.expires_at(m_connect_timer.expires_at() +
-                                               boost::posix_time::milliseconds(m_reconnectTime));
-                    m_connect_timer.async_wait(
-                          karabo::util::bind_weak(&SlsControl::connect, this, boost::asio::placeholders::error));
+                    this->scheduleReconnect();
                 }
 
                 return;
@@ -675,8 +1080,26 @@ namespace karabo {
         this->startPoll();
     }
 
+    void SlsControl::scheduleReconnect() {
+        // Exponential backoff, with a random factor in [0.5, 1] not to be synchronized with other devices
+        unsigned int delay = 0;
+        if (m_reconnectAttempts > 0) {
+            const unsigned int maxInterval = this->get<unsigned int>("reconnectMaxInterval");
+            const unsigned int exponent = std::min(m_reconnectAttempts - 1, 16u);
+            const unsigned int interval = std::min(reconnectFirstDelay << exponent, maxInterval);
+            delay = std::uniform_int_distribution<unsigned int>(interval / 2, interval)(m_random);
+        }
+        ++m_reconnectAttempts;
+
+        KARABO_LOG_FRAMEWORK_DEBUG << "Reconnection attempt " << m_reconnectAttempts << " in " << delay << " ms";
+        m_connect_timer.expires_from_now(boost::posix_time::milliseconds(delay));
+        m_connect_timer.async_wait(
+              karabo::util::bind_weak(&SlsControl::connect, this, boost::asio::placeholders::error));
+    }
+
     void SlsControl::startPoll() {
         m_poll = true;
+        m_lastTransitionTime = std::chrono::steady_clock::now(); // Fast polling at first
 
         m_status_timer.expires_from_now(boost::posix_time::seconds(1));
         m_status_timer.async_wait(
@@ -698,17 +1121,15 @@ namespace karabo {
         if (ec) {
             return;
         }
+        const auto pollStart = std::chrono::steady_clock::now();
 
         try {
             std::scoped_lock lock(m_status_mtx);
-            // If the 'start' slot is called concurrently, we might stop here the acquisition mistakingly
 
-            const std::vector<std::string> hosts = this->get<std::vector<std::string>>("detectorHostName");
-            for (const std::string& hostname : hosts) {
-                // Verify that the detector is online
-                if (!this->ping(hostname)) {
-                    throw std::runtime_error(hostname + " is not pingable");
-                }
+            // Verify that the detectors are online (cached results, not to block the polling)
+            const std::vector<std::string> unreachable = this->getUnreachableHosts(HostType::detector, false);
+            if (!unreachable.empty()) {
+                throw std::runtime_error(unreachable.front() + " is not reachable");
             }
 
             const std::vector<slsDetectorDefs::runStatus> status = m_SLS->getDetectorStatus();
@@ -721,11 +1142,11 @@ namespace karabo {
                 }
             }
 
-            if (this->getState() == State::ACQUIRING && !is_acquiring) {
+            if (this->getState() == State::ACQUIRING && !is_acquiring && !m_starting) {
                 // The acquisition is over: either restart it if `acquireForever` is set, or update the device state.
                 if (m_acquireForever) {
-                    KARABO_LOG_FRAMEWORK_DEBUG << "Restarting acquisition";
-                    m_SLS->startDetector();
+                    // Normally done already by 'checkAcquisitionStatus'
+                    this->restartAcquisition();
                 } else {
                     m_SLS->stopReceiver();
                     this->updateState(State::ON, Hash("status", "Acquisition finished"));
@@ -741,20 +1162,19 @@ namespace karabo {
             m_isConfigured = false;
             m_firstPoll = true;
             m_connect = true;
-            m_connect_timer.expires_from_now(boost::posix_time::milliseconds(m_reconnectTime));
-            m_connect_timer.async_wait(
-                  karabo::util::bind_weak(&SlsControl::connect, this, boost::asio::placeholders::error));
+            m_recovering = true;
+            m_disconnectTime = std::chrono::steady_clock::now();
+            m_reconnectAttempts = 0;
+            this->scheduleReconnect();
             return;
         }
 
         if (this->getState() != State::ERROR) {
             try {
-                const std::vector<std::string> hosts = this->get<std::vector<std::string>>("rxHostname");
-                for (const std::string& hostname : hosts) {
-                    // Verify that the receiver host is online
-                    if (!this->ping(hostname)) {
-                        throw std::runtime_error(hostname + " is not pingable");
-                    }
+                // Verify that the receiver hosts are online
+                const std::vector<std::string> unreachable = this->getUnreachableHosts(HostType::receiver, false);
+                if (!unreachable.empty()) {
+                    throw std::runtime_error(unreachable.front() + " is not reachable");
                 }
 
                 m_SLS->getReceiverStatus();
@@ -764,8 +1184,32 @@ namespace karabo {
             }
         }
 
+        const auto now = std::chrono::steady_clock::now();
+        const float elapsed = std::chrono::duration<float, std::milli>(now - pollStart).count();
+        Hash h;
+        this->checkPollBudget("status", elapsed, h);
+        m_statusPollTimeMax = std::max(m_statusPollTimeMax, elapsed);
+        if (now - m_statusPollTimePublished >= std::chrono::seconds(1)) {
+            h.set("statusPollTime", m_statusPollTimeMax);
+            m_statusPollTimeMax = 0.f;
+            m_statusPollTimePublished = now;
+        }
+        if (!h.empty()) {
+            this->set(h);
+        }
+
+        const State state = this->getState();
+        if (state.name() != m_lastPolledState) {
+            m_lastPolledState = state.name();
+            m_lastTransitionTime = now;
+        }
+        const bool fast = (state == State::ACQUIRING || state == State::INIT ||
+                           now - m_lastTransitionTime < std::chrono::milliseconds(statusTransitionWindow));
+
         if (m_poll) {
-            m_status_timer.expires_at(m_status_timer.expires_at() + boost::posix_time::milliseconds(100));
+            // Relative to now: an overrun must not be followed by a burst of polls
+            m_status_timer.expires_from_now(boost::posix_time::milliseconds(
+                  this->get<unsigned int>(fast ? "statusPollingFast" : "statusPollingSlow")));
             m_status_timer.async_wait(
                   karabo::util::bind_weak(&SlsControl::pollStatus, this, boost::asio::placeholders::error));
             return;
@@ -780,6 +1224,7 @@ namespace karabo {
 
         if (m_isConfigured) {
             // Can only poll after the base cfg (i.e. host) has been applied
+            const auto pollStart = std::chrono::steady_clock::now();
             Hash h;
 
             if (m_firstPoll) {
@@ -792,6 +1237,11 @@ namespace karabo {
             // Poll detector specific parameters
             this->pollDetectorSpecific(h);
 
+            const float elapsed =
+                  std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - pollStart).count();
+            h.set("hardwarePollTime", elapsed);
+            this->checkPollBudget("hardware", elapsed, h);
+
             if (!h.empty()) {
                 this->set(h); // bulk set
             }
@@ -807,6 +1257,18 @@ namespace karabo {
     }
 
 
+    void SlsControl::checkPollBudget(const std::string& poll, float elapsed, karabo::data::Hash& h) {
+        const unsigned int budget = this->get<unsigned int>(poll + "PollingBudget");
+        if (elapsed <= budget) {
+            return;
+        }
+
+        unsigned int& overruns = (poll == "status") ? m_statusPollOverruns : m_hardwarePollOverruns;
+        h.set(poll + "PollOverruns", ++overruns);
+        KARABO_LOG_FRAMEWORK_WARN << "Polling the " << poll << " took " << elapsed << " ms, budget is " << budget
+                                  << " ms";
+    }
+
     void SlsControl::pollOnce(karabo::data::Hash& h) {
         std::stringstream ss;
         ss << std::hex << std::showbase << m_SLS->getClientVersion();
@@ -835,8 +1297,8 @@ namespace karabo {
 
         h.set<std::vector<std::string>>("receiverVersion", m_SLS->getReceiverVersion(m_positions));
 
-        const karabo::data::Schema schema = this->getFullSchema();
-        if (schema.has("chipVersion")) { // Jungfrau only
+        const std::shared_ptr<const KeyTable> keyTable = this->getKeyTable();
+        if (keyTable && keyTable->count("chipVersion") > 0) { // Jungfrau only
             const std::vector<double> chipVersion = m_SLS->getChipVersion(m_positions);
             h.set("chipVersion", chipVersion);
         }
@@ -875,45 +1337,41 @@ namespace karabo {
                               "!= " + toString(m_numberOfModules)));
         }
 
-        const std::string fname = m_tmpDir + "/base.config";
-        std::ofstream configFile(fname.c_str(), std::ofstream::trunc);
-        if (configFile.is_open()) {
-            configFile << "hostname ";
-            for (auto hostname : hostnames) {
-                configFile << hostname << "+";
-            }
-            configFile << std::endl;
-
-            for (size_t i = 0; i < m_numberOfModules; ++i) {
-                // Please note: order of the parameter matters!
-                configFile << i << ":udp_dstport " << udp_dst_ports[i] << std::endl;
-                configFile << i << ":rx_tcpport " << rx_tcpports[i] << std::endl;
-                configFile << i << ":udp_srcip " << udp_src_ips[i] << std::endl;
-                configFile << i << ":udp_dstip " << udp_dst_ips[i] << std::endl;
-                configFile << i << ":rx_hostname " << rx_hostnames[i] << std::endl;
-            }
-            configFile.close();
+        // The base configuration is applied from memory: unlike loadConfig, this does not free and reallocate
+        // the SLS shared memory. The hostnames are set by connect(), only when changed.
+        std::vector<std::string> commands;
+
+        // The detector forgets the UDP configuration when power cycled: always send it
+        for (size_t i = 0; i < m_numberOfModules; ++i) {
+            // Please note: order of the parameter matters!
+            this->appendCommand(commands, "udp_dstport", toString(udp_dst_ports[i]), i);
+            this->appendCommand(commands, "rx_tcpport", toString(rx_tcpports[i]), i);
+            this->appendCommand(commands, "udp_srcip", udp_src_ips[i], i);
+            this->appendCommand(commands, "udp_dstip", udp_dst_ips[i], i);
+            this->appendCommand(commands, "rx_hostname", rx_hostnames[i], i);
+        }
 
-            m_SLS->loadConfig(fname); // This will also free SLS shared memory
+        // Whole configuration to be sent again
+        m_shadow.clear();
+        this->sendCommands(commands);
 
-            this->powerOn();
+        this->powerOn();
 
-            m_isConfigured = true;
-        } else {
-            throw KARABO_RECONFIGURE_EXCEPTION("Could not open file " + fname + "for writing");
-        }
+        m_isConfigured = true;
     }
 
     void SlsControl::sendInitialConfiguration() {
-        // Get current configuration
-        const Hash configHash = this->getCurrentConfiguration("sls");
+        // Get current configuration, filtered by the "sls" tag in appendCommands
+        const Hash configHash = this->getCurrentConfiguration();
 
         // Send some more parameters, not from configuration hash
-        this->sendConfiguration("settingspath", m_tmpDir); // settings directory
-        this->sendConfiguration("fformat", "binary");      // file format
+        std::vector<std::string> commands;
+        this->appendCommand(commands, "settingspath", m_tmpDir); // settings directory
+        this->appendCommand(commands, "fformat", "binary");      // file format
 
-        // Send all other parameters, from configuration hash
-        this->sendConfiguration(configHash);
+        // Send all other parameters, from configuration hash, in the same batch
+        this->appendCommands(commands, configHash, "sls");
+        this->sendCommands(commands, true);
 
         KARABO_LOG_FRAMEWORK_DEBUG << "Configuration done";
         this->set("status", "Configuration done");
@@ -921,45 +1379,67 @@ namespace karabo {
         KARABO_LOG_FRAMEWORK_DEBUG << "Quitting SlsControl::sendInitialConfiguration";
     }
 
-    void SlsControl::sendConfiguration(const karabo::data::Hash& configHash) {
+    void SlsControl::sendConfiguration(const karabo::data::Hash& configHash, const std::string& tag) {
         KARABO_LOG_FRAMEWORK_DEBUG << "Entering SlsControl::sendConfiguration";
 
-        // Check that detector and receiver are online
-        const State& state = this->getState();
-        if (state == State::UNKNOWN || state == State::ERROR) {
-            KARABO_LOG_ERROR << "sendConfiguration(): detector or receiver is not online. Aborting!";
-            return;
-        }
+        std::vector<std::string> commands;
+        this->appendCommands(commands, configHash, tag);
+        this->sendCommands(commands, true);
 
+        KARABO_LOG_DEBUG << "Quitting SlsControl::sendConfiguration";
+    }
+
+    void SlsControl::appendCommands(std::vector<std::string>& commands, const karabo::data::Hash& configHash,
+                                    const std::string& tag) {
         Hash flat;
         Hash::flatten(configHash, flat);
 
-        const Schema& fullSchema = this->getFullSchema();
-        std::string key, alias;
+        std::shared_ptr<const KeyTable> keyTable = this->getKeyTable();
+        if (!keyTable) {
+            // Not initialized yet
+            this->buildKeyTable();
+            keyTable = this->getKeyTable();
+        }
+
         for (auto it = flat.begin(); it != flat.end(); ++it) {
-            key = it->getKey();
-            if (fullSchema.isAccessReadOnly(key)) {
+            const std::string& key = it->getKey();
+            const auto keyIt = keyTable->find(key);
+            if (!tag.empty() && (keyIt == keyTable->end() ||
+                                 std::find(keyIt->second.tags.begin(), keyIt->second.tags.end(), tag) ==
+                                       keyIt->second.tags.end())) {
+                continue; // Not tagged
+            }
+            if (keyIt == keyTable->end() || keyIt->second.alias.empty()) {
+                KARABO_LOG_FRAMEWORK_WARN << "SlsControl::sendConfiguration - key: " << key
+                                          << " has no SLS command -> Skip";
+                continue;
+            }
+            const KeyInfo& info = keyIt->second;
+            if (info.readOnly) {
                 KARABO_LOG_FRAMEWORK_DEBUG << "SlsControl::sendConfiguration - key: " << key << " is Read-Only -> Skip";
                 continue;
             }
-            alias = this->getAliasFromKey<std::string>(key);
-            const Types::ReferenceType type = configHash.getType(key);
+            const std::string& alias = info.alias;
+            const Types::ReferenceType type = info.type;
 
             KARABO_LOG_FRAMEWORK_DEBUG << "SlsControl::sendConfiguration - Key: " << key << " Type: " << type;
 
-            if (Types::isSimple(type)) {
+            if (!info.isVector && Types::isSimple(type)) {
+                std::string value;
                 if (type == Types::FLOAT || type == Types::DOUBLE) {
                     // We have to convert the value to fixed floating-point notation
                     std::stringstream ss;
                     ss.precision(9);
                     ss << std::fixed << configHash.getAs<double>(key);
-                    this->sendConfiguration(alias, ss.str());
+                    value = ss.str();
                 } else {
-                    const std::string value = configHash.getAs<std::string>(key);
-                    this->sendConfiguration(alias, value);
+                    value = configHash.getAs<std::string>(key);
+                }
+                if (!m_shadow.isApplied(alias, value, -1)) {
+                    this->appendCommand(commands, alias, value);
                 }
 
-            } else if (Types::isVector(type)) {
+            } else if (info.isVector) {
                 // XXX Here we possibly have to use std::to_string for
                 // vectors of floate/doubles -> see simple types
                 const auto values = configHash.getAs<std::string, std::vector>(key);
@@ -967,10 +1447,14 @@ namespace karabo {
                     continue; // ignore key
                 } else if (values.size() == 1) {
                     // send same value to all
-                    this->sendConfiguration(alias, values[0]);
+                    if (!m_shadow.isApplied(alias, values[0], -1)) {
+                        this->appendCommand(commands, alias, values[0]);
+                    }
                 } else if (values.size() == m_numberOfModules) {
                     for (size_t i = 0; i < values.size(); ++i) {
-                        this->sendConfiguration(alias, values[i], i);
+                        if (!m_shadow.isApplied(alias, values[i], i)) {
+                            this->appendCommand(commands, alias, values[i], i);
+                        }
                     }
                 } else {
                     KARABO_LOG_ERROR << "SlsControl::sendConfiguration error: " << key << " has " << values.size()
@@ -983,23 +1467,49 @@ namespace karabo {
                 continue;
             }
         }
-
-        KARABO_LOG_DEBUG << "Quitting SlsControl::sendConfiguration";
     }
 
-    // Return true if host is pingable.
-    // This function could still return success if the host is in a protected
-    // network, but in the latter case the device will fail in the
-    // configuration step.
-    bool SlsControl::ping(std::string host) {
+    // The reachability of a host is checked in-process, with ICMP or TCP probes (see ReachabilityProber).
+    // A host could still be reachable in a protected network, but in the latter case the device will fail
+    // in the configuration step.
+    std::vector<std::string> SlsControl::getUnreachableHosts(HostType type, bool wait) {
+        const bool isDetector = (type == HostType::detector);
+        const auto hosts = this->get<std::vector<std::string>>(isDetector ? "detectorHostName" : "rxHostname");
+        std::vector<bool> reachable(hosts.size(), true);
+
 #ifndef SLS_SIMULATION
-        const std::string command = std::string("ping -c1 -s1 -W2 ") + host + " > /dev/null 2>&1";
+        // Detector control port, or receiver TCP port
+        const auto ports = this->get<std::vector<unsigned short>>(isDetector ? "detectorHostPort" : "rxTcpPort");
+        std::vector<ReachabilityProber::Target> targets;
+        for (size_t i = 0; i < hosts.size(); ++i) {
+            const unsigned short port = (i < ports.size()) ? ports[i] : (isDetector ? m_defaultPort : 1954);
+            targets.push_back({hosts[i], port});
+        }
 
-        const int err = system(command.c_str());
-        return (err == 0);
-#else
-        return true;
+        if (wait) {
+            reachable = m_prober->probe(targets);
+        } else {
+            const std::vector<ReachabilityProber::Reachability> results = m_prober->getReachability(targets);
+            for (size_t i = 0; i < results.size(); ++i) {
+                reachable[i] = (results[i] != ReachabilityProber::Reachability::unreachable);
+            }
+        }
 #endif
+
+        std::vector<bool>& published = isDetector ? m_detectorReachable : m_rxReachable;
+        if (reachable != published) {
+            published = reachable;
+            this->set(Hash(isDetector ? "detectorReachable" : "rxReachable", reachable, "reachabilityMethod",
+                           m_prober->getMethod()));
+        }
+
+        std::vector<std::string> unreachable;
+        for (size_t i = 0; i < hosts.size(); ++i) {
+            if (!reachable[i]) {
+                unreachable.push_back(hosts[i]);
+            }
+        }
+        return unreachable;
     }
 
     void SlsControl::createTmpDir() {
@@ -1016,6 +1526,35 @@ namespace karabo {
         KARABO_LOG_FRAMEWORK_DEBUG << "Created temporary dir" << m_tmpDir;
     }
 
+    void SlsControl::buildKeyTable() {
+        const Schema fullSchema = this->getFullSchema();
+        auto keyTable = std::make_shared<KeyTable>();
+        for (const std::string& path : fullSchema.getPaths()) {
+            if (!fullSchema.isLeaf(path)) {
+                continue;
+            }
+
+            KeyInfo& info = (*keyTable)[path];
+            info.alias = fullSchema.keyHasAlias(path) ? fullSchema.getAliasFromKey<std::string>(path) : "";
+            if (fullSchema.hasTags(path)) {
+                info.tags = fullSchema.getTags(path);
+            }
+            info.readOnly = fullSchema.isAccessReadOnly(path);
+            info.type = fullSchema.getValueType(path);
+            info.isVector = Types::isVector(info.type);
+        }
+
+        KARABO_LOG_FRAMEWORK_DEBUG << "Key table built with " << keyTable->size() << " keys";
+        std::scoped_lock lock(m_keyTableMutex);
+        m_keyTable = std::move(keyTable);
+    }
+
+    std::shared_ptr<const KeyTable> SlsControl::getKeyTable() const {
+        // The returned table stays valid, even if replaced in the meantime
+        std::scoped_lock lock(m_keyTableMutex);
+        return m_keyTable;
+    }
+
     void SlsControl::createCalibrationAndSettings(const std::string& settings) {
         KARABO_LOG_FRAMEWORK_DEBUG << "Entering SlsControl::createCalibrationAndSettings";
 
@@ -1051,15 +1590,13 @@ namespace karabo {
     }
 
     void SlsControl::sendConfiguration(const std::string& command, const std::string& parameters, int pos) {
-        KARABO_LOG_DEBUG << "Entering SlsControl::sendConfiguration";
-
-        // Check that detector and receiver are online
-        const State& state = this->getState();
-        if (state == State::UNKNOWN || state == State::ERROR) {
-            KARABO_LOG_FRAMEWORK_ERROR << "sendConfiguration(): detector or receiver is not online. Aborting!";
-            return;
-        }
+        std::vector<std::string> commands;
+        this->appendCommand(commands, command, parameters, pos);
+        this->sendCommands(commands);
+    }
 
+    void SlsControl::appendCommand(std::vector<std::string>& commands, const std::string& command,
+                                   const std::string& parameters, int pos) {
         if (command.size() == 0) {
             KARABO_LOG_FRAMEWORK_WARN << "SlsControl::sendConfiguration skip empty command";
             return;
@@ -1079,11 +1616,53 @@ namespace karabo {
             command_and_parameters << " " << parameters;
         }
 
-        m_SLS->loadParameters(std::vector<std::string>({command_and_parameters.str()}));
+        commands.push_back(command_and_parameters.str());
+    }
+
+    void SlsControl::sendCommands(const std::vector<std::string>& commands, bool updateShadow) {
+        // Check that detector and receiver are online
+        const State& state = this->getState();
+        if (state == State::UNKNOWN || state == State::ERROR) {
+            KARABO_LOG_FRAMEWORK_ERROR << "sendConfiguration(): detector or receiver is not online. Aborting!";
+            // The device configuration is now ahead of the applied one: it will have to be derived again
+            m_shadow.clearAppliedCommands();
+            return;
+        } else if (commands.empty()) {
+            return;
+        }
+
+        // A single call for all the commands, which are executed in order
+        const auto start = std::chrono::steady_clock::now();
+        try {
+            m_SLS->loadParameters(commands);
+        } catch (...) {
+            // Unknown which commands have been applied
+            m_shadow.update(commands, false, m_numberOfModules);
+            // Restoring the others only would leave the detector with a partial configuration
+            m_shadow.clearAppliedCommands();
+            throw;
+        }
+        const std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        // Commands not coming from the configuration (e.g. with sub-commands) are not shadowed
+        m_shadow.update(commands, updateShadow, m_numberOfModules);
+
+        for (const std::string& command : commands) {
+            KARABO_LOG_FRAMEWORK_DEBUG << "Sent configuration: " << command;
+        }
+        KARABO_LOG_FRAMEWORK_INFO << "Sent " << commands.size() << " configuration command(s) in "
+                                  << elapsed.count() << " ms";
+    }
 
-        KARABO_LOG_FRAMEWORK_DEBUG << "Sent configuration: " << command_and_parameters.str();
+    bool SlsControl::restoreConfiguration() {
+        const std::vector<std::string> commands = m_shadow.getAppliedCommands();
+        if (commands.empty()) {
+            return false;
+        }
 
-        KARABO_LOG_DEBUG << "Quitting SlsControl::sendConfiguration";
+        this->sendCommands(commands, true);
+        KARABO_LOG_FRAMEWORK_DEBUG << "Configuration restored";
+        this->set("status", "Configuration restored");
+        return true;
     }
 
     void SlsControl::preReconfigure(Hash& incomingReconfiguration) {
@@ -1107,10 +1686,8 @@ namespace karabo {
             }
         }
 
-        const Hash h1 = this->filterByTags(incomingReconfiguration, "sls");
-        KARABO_LOG_FRAMEWORK_DEBUG << "Filtered reconfiguration: \n" << h1;
-
-        this->sendConfiguration(h1);
+        // Only the parameters tagged "sls" are sent
+        this->sendConfiguration(incomingReconfiguration, "sls");
 
         // Send detector specific configuration
         this->configureDetectorSpecific(incomingReconfiguration);
@@ -1193,6 +1770,10 @@ namespace karabo {
             }
         }
 
+        if (incomingReconfiguration.has("reachabilityTtl")) {
+            m_prober->setTtl(incomingReconfiguration.get<float>("reachabilityTtl"));
+        }
+
         if (incomingReconfiguration.has("pollingInterval") && m_poll) {
             // Stop and restart polling, such that new pollingInterval will be applied
             m_poll = false;
@@ -1217,6 +1798,7 @@ namespace karabo {
         // Stop deadline timers
         m_connect = false;
         m_connect_timer.cancel();
+        m_acquisition_timer.cancel();
         this->stopPoll();
 
         // Power off
@@ -12,6 +12,7 @@
 
 
 #include <karabo/karabo.hpp>
+#include <random>
 
 #ifndef SLS_SIMULATION
 #include <sls/Detector.h>
@@ -20,6 +21,8 @@
 #endif
 
 #include "../common/version.hh" // provides SLSDETECTORS_PACKAGE_VERSION
+#include "ConfigurationShadow.hh"
+#include "ReachabilityProber.hh"
 
 /**
  * The main Karabo namespace
@@ -28,6 +31,17 @@ namespace karabo {
 
     enum class HostType { detector, receiver };
 
+    // Schema information about a device parameter, as needed for sending it to the detector
+    struct KeyInfo {
+        std::string alias; // The SLS command, empty if none
+        std::vector<std::string> tags;
+        bool readOnly;
+        karabo::data::Types::ReferenceType type;
+        bool isVector; // One value per module, or the same for all if a single value
+    };
+
+    using KeyTable = std::map<std::string, KeyInfo>;
+
     class SlsControl : public karabo::core::Device {
        public:
         KARABO_CLASSINFO(SlsControl, "SlsControl", SLSDETECTORS_PACKAGE_VERSION)
@@ -46,28 +60,72 @@ namespace karabo {
         void start();
         void stop();
         void reset();
+        void resendConfiguration();
 
        private: // Functions
         void initialize();
 
         void connect(const boost::system::error_code& ec);
+        void scheduleReconnect();
+
+        // Acquisition start and stop, executed in m_strand
+        void startAcquisition();
+        void stopAcquisition();
+        void onAcquisitionTimer(const boost::system::error_code& ec);
+        void checkAcquisitionStatus();
+        void scheduleAcquisitionCheck(unsigned int delay);
+
+        // In continuous mode, the status is watched fast only close to the expected end of the acquisition
+        float getExpectedDuration();
+        unsigned int getRestartWatchDelay(const std::chrono::steady_clock::time_point& now);
+
+        // Re-arm the detector in continuous mode, to be called with m_status_mtx locked
+        void restartAcquisition();
 
         void startPoll();
         void stopPoll();
         void pollStatus(const boost::system::error_code& ec);
         void pollHardware(const boost::system::error_code& ec);
         void pollOnce(karabo::data::Hash& h);
+
+        /**
+         * Check the duration of a poll against its budget, and count the overruns.
+         *
+         * @param poll "status" or "hardware"
+         * @param elapsed the duration of the poll [ms]
+         * @param h where the overrun counter is set, if incremented
+         */
+        void checkPollBudget(const std::string& poll, float elapsed, karabo::data::Hash& h);
         virtual void pollDetectorSpecific(karabo::data::Hash& h){};
 
         void sendBaseConfiguration();
         void sendInitialConfiguration();
-        void sendConfiguration(const karabo::data::Hash& configHash);
+        void sendConfiguration(const karabo::data::Hash& configHash, const std::string& tag = "");
+
+        // Configuration commands are collected, then sent in a single batch. If a tag is given, only the keys
+        // having it are sent (this replaces filterByTags, which walks the schema).
+        void appendCommands(std::vector<std::string>& commands, const karabo::data::Hash& configHash,
+                            const std::string& tag = "");
+        void appendCommand(std::vector<std::string>& commands, const std::string& command,
+                           const std::string& parameters = "", int pos = -1);
+        void sendCommands(const std::vector<std::string>& commands, bool updateShadow = false);
+
+        // Send again the applied configuration, in a single batch. Return false if there is nothing to restore.
+        bool restoreConfiguration();
         virtual void configureDetectorSpecific(const karabo::data::Hash& configHash){};
 
         virtual void powerOn(){};
         virtual void powerOff(){};
 
-        bool ping(std::string host);
+        /**
+         * Check whether the detector modules or the receiver hosts are reachable. The results per module are
+         * published.
+         *
+         * @param type the hosts to check
+         * @param wait if false, do not block and use the cached results (hosts not probed yet count as reachable)
+         * @return the hosts which are not reachable
+         */
+        std::vector<std::string> getUnreachableHosts(HostType type, bool wait);
 
         void createTmpDir();
 
@@ -82,12 +140,22 @@ namespace karabo {
         void sendConfiguration(const std::string& command, const std::string& parameters = "", int pos = -1);
         void createCalibrationAndSettings(const std::string& settings);
 
+        /**
+         * Build the table of the device parameters from the full schema, such that the schema needs not be walked
+         * for each configuration. It is built at initialization, and must be built again after a schema update.
+         */
+        void buildKeyTable();
+        std::shared_ptr<const KeyTable> getKeyTable() const;
+
        private: // Members
         const unsigned short m_defaultPort = 1952;
 
         bool m_connect;
-        const unsigned int m_reconnectTime = 5000;
         boost::asio::deadline_timer m_connect_timer;
+        unsigned int m_reconnectAttempts;
+        std::mt19937 m_random; // For the reconnection jitter
+        bool m_recovering; // Connection lost, since m_disconnectTime
+        std::chrono::steady_clock::time_point m_disconnectTime;
 
         bool m_isConfigured; // modules can be polled only after hostnames are set
         bool m_firstPoll;
@@ -96,8 +164,42 @@ namespace karabo {
         boost::asio::deadline_timer m_status_timer;
         boost::asio::deadline_timer m_poll_timer;
 
+        // The status is polled fast while acquiring and after state transitions, slowly otherwise
+        std::string m_lastPolledState;
+        std::chrono::steady_clock::time_point m_lastTransitionTime;
+        float m_statusPollTimeMax; // [ms], since last published
+        std::chrono::steady_clock::time_point m_statusPollTimePublished;
+        unsigned int m_statusPollOverruns;
+        unsigned int m_hardwarePollOverruns;
+
+        // Start and stop do not block the event loop: they are serialized in m_strand, and the acquisition
+        // status is checked with an exponentially increasing delay. In continuous mode, the status is then
+        // watched at a short interval, for restarting the detector as soon as it gets idle.
+        karabo::net::Strand::Pointer m_strand;
+        boost::asio::deadline_timer m_acquisition_timer;
+        bool m_starting; // Acquisition started, but not yet seen by the detector (protected by m_status_mtx)
+        unsigned int m_startCheckDelay; // [ms]
+        std::chrono::steady_clock::time_point m_startTime;
+        float m_expectedDuration; // [ms] from m_startTime, 0 if unknown
+        std::chrono::steady_clock::time_point m_lastAcquiringTime; // Last time the detector was seen acquiring
+        unsigned int m_restartCount;
+
         bool m_acquireForever;
 
+        std::unique_ptr<ReachabilityProber> m_prober;
+        std::vector<bool> m_detectorReachable;
+        std::vector<bool> m_rxReachable;
+
+        // Shadow of the configuration applied to the detector, for sending only the changed values
+        ConfigurationShadow m_shadow;
+
+        // Hostnames applied to m_SLS, for not setting them again
+        std::vector<std::string> m_appliedHostnames;
+
+        // The table of device parameters. Not modified once built, but replaced by buildKeyTable.
+        std::shared_ptr<const KeyTable> m_keyTable;
+        mutable std::mutex m_keyTableMutex;
+
         std::string m_tmpDir;
         unsigned int m_shm_id; // shared memory segment index
     };
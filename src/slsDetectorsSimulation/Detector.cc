@@ -647,6 +647,14 @@ namespace sls {
         m_register[addr] = val;
     }
 
+    void Detector::setBit(uint32_t addr, int bitnr, Positions pos) {
+        m_register[addr] |= (1u << bitnr);
+    }
+
+    void Detector::clearBit(uint32_t addr, int bitnr, Positions pos) {
+        m_register[addr] &= ~(1u << bitnr);
+    }
+
     int Detector::dumpDetectorSetup(std::string const fname) {
         std::ofstream cfile;
 
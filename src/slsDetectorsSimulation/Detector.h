@@ -207,6 +207,10 @@ namespace sls {
 
         void writeRegister(uint32_t addr, uint32_t val, bool validate = false, Positions pos = {});
 
+        void setBit(uint32_t addr, int bitnr, Positions pos = {});
+
+        void clearBit(uint32_t addr, int bitnr, Positions pos = {});
+
         // Not available in "real" Detector
         slsDetectorDefs::detectorType setDetectorType(slsDetectorDefs::detectorType type);
 
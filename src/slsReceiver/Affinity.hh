@@ -0,0 +1,207 @@
+/*
+ * Copyright (c) European XFEL GmbH Schenefeld. All rights reserved.
+ */
+
+#ifndef KARABO_AFFINITY_HH
+#define KARABO_AFFINITY_HH
+
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+/**
+ * The main Karabo namespace
+ */
+namespace karabo {
+
+    /**
+     * Parse a CPU list, in the format used by taskset and /sys (e.g. "0-3,8,10-11").
+     *
+     * @param cpuList the CPU list, empty for no CPU
+     * @return the CPUs, sorted and without duplicates
+     */
+    inline std::vector<int> parseCpuList(const std::string& cpuList) {
+        std::vector<int> cpus;
+        std::istringstream tokens(cpuList);
+        std::string token;
+        while (std::getline(tokens, token, ',')) {
+            token.erase(std::remove(token.begin(), token.end(), ' '), token.end());
+            if (token.empty()) {
+                continue;
+            }
+
+            // Single CPU, or range "first-last"
+            const size_t dash = token.find('-');
+            const auto toCpu = [&cpuList](const std::string& number) {
+                size_t length = 0;
+                int cpu = -1;
+                try {
+                    cpu = std::stoi(number, &length);
+                } catch (const std::exception&) {
+                }
+                if (length == 0 || length != number.size()) {
+                    throw std::invalid_argument("Invalid CPU list: " + cpuList);
+                }
+                return cpu;
+            };
+            const int first = toCpu(token.substr(0, dash));
+            const int last = (dash == std::string::npos) ? first : toCpu(token.substr(dash + 1));
+            if (first < 0 || last < first || last >= CPU_SETSIZE) {
+                throw std::invalid_argument("Invalid CPU range in list: " + token);
+            }
+            for (int cpu = first; cpu <= last; ++cpu) {
+                cpus.push_back(cpu);
+            }
+        }
+
+        std::sort(cpus.begin(), cpus.end());
+        cpus.erase(std::unique(cpus.begin(), cpus.end()), cpus.end());
+        return cpus;
+    }
+
+    // The inverse of parseCpuList
+    inline std::string formatCpuList(const std::vector<int>& cpus) {
+        std::ostringstream cpuList;
+        for (size_t i = 0; i < cpus.size();) {
+            size_t j = i;
+            while (j + 1 < cpus.size() && cpus[j + 1] == cpus[j] + 1) {
+                ++j;
+            }
+            cpuList << (i > 0 ? "," : "") << cpus[i];
+            if (j > i) {
+                cpuList << "-" << cpus[j];
+            }
+            i = j + 1;
+        }
+        return cpuList.str();
+    }
+
+    // The CPUs the calling thread is allowed to run on
+    inline std::vector<int> getThreadAffinity() {
+        std::vector<int> cpus;
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        if (pthread_getaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet) == 0) {
+            for (int cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+                if (CPU_ISSET(cpu, &cpuSet)) {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+        return cpus;
+    }
+
+    /**
+     * Restrict the calling thread to the given CPUs.
+     *
+     * @param cpus the CPUs, nothing is done if empty
+     * @return false if the affinity could not be set
+     */
+    inline bool setThreadAffinity(const std::vector<int>& cpus) {
+        if (cpus.empty()) {
+            return true;
+        }
+
+        cpu_set_t cpuSet;
+        CPU_ZERO(&cpuSet);
+        for (int cpu : cpus) {
+            CPU_SET(cpu, &cpuSet);
+        }
+        return pthread_setaffinity_np(pthread_self(), sizeof(cpu_set_t), &cpuSet) == 0;
+    }
+
+    // The NUMA nodes of the CPUs, from /sys (empty if not available)
+    inline std::vector<int> getCpuNodes(const std::vector<int>& cpus) {
+        std::vector<int> nodes;
+        for (int cpu : cpus) {
+            const std::filesystem::path cpuDir("/sys/devices/system/cpu/cpu" + std::to_string(cpu));
+            std::error_code ec;
+            for (const auto& entry : std::filesystem::directory_iterator(cpuDir, ec)) {
+                const std::string name = entry.path().filename().string();
+                if (name.rfind("node", 0) == 0 && name.size() > 4 &&
+                    name.find_first_not_of("0123456789", 4) == std::string::npos) {
+                    nodes.push_back(std::stoi(name.substr(4)));
+                }
+            }
+        }
+
+        std::sort(nodes.begin(), nodes.end());
+        nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+        return nodes;
+    }
+
+    /**
+     * Allocate memory directly from the kernel. Unlike the heap, which can reuse already touched pages, the pages
+     * are placed on the NUMA node of the thread writing them first.
+     *
+     * @param bytes the size, nothing is allocated if 0
+     * @return the page-aligned memory, to be released with freePages
+     */
+    inline void* allocatePages(size_t bytes) {
+        if (bytes == 0) {
+            return nullptr;
+        }
+        void* address = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (address == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        return address;
+    }
+
+    inline void freePages(void* address, size_t bytes) {
+        if (address != nullptr) {
+            munmap(address, bytes);
+        }
+    }
+
+    /**
+     * The NUMA nodes the memory pages are actually placed on.
+     *
+     * @param address page-aligned memory, e.g. from allocatePages
+     * @param bytes the size
+     * @param maxPages the number of pages sampled
+     * @return the nodes, empty if not available (or if no page is placed yet)
+     */
+    inline std::vector<int> getPageNodes(const void* address, size_t bytes, size_t maxPages = 64) {
+        std::vector<int> nodes;
+#ifdef SYS_move_pages
+        const size_t pageSize = sysconf(_SC_PAGESIZE);
+        const size_t pages = (bytes + pageSize - 1) / pageSize;
+        if (address == nullptr || pages == 0) {
+            return nodes;
+        }
+
+        const size_t step = std::max<size_t>(1, pages / maxPages);
+        std::vector<void*> addresses;
+        for (size_t page = 0; page < pages; page += step) {
+            addresses.push_back(const_cast<char*>(static_cast<const char*>(address)) + page * pageSize);
+        }
+        std::vector<int> status(addresses.size(), -1);
+        // Without target nodes, move_pages only reports the node of each page
+        if (syscall(SYS_move_pages, 0, addresses.size(), addresses.data(), nullptr, status.data(), 0) == 0) {
+            for (int node : status) {
+                if (node >= 0) {
+                    nodes.push_back(node);
+                }
+            }
+        }
+
+        std::sort(nodes.begin(), nodes.end());
+        nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+#endif
+        return nodes;
+    }
+
+} /* namespace karabo */
+
+#endif /* KARABO_AFFINITY_HH */
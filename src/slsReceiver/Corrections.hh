@@ -0,0 +1,100 @@
+/*
+ * Copyright (c) European XFEL GmbH Schenefeld. All rights reserved.
+ */
+
+#ifndef KARABO_CORRECTIONS_HH
+#define KARABO_CORRECTIONS_HH
+
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+/**
+ * The main Karabo namespace
+ */
+namespace karabo {
+
+    // The gain is encoded in 2 bits
+    constexpr size_t NUMBER_OF_GAINS = 4;
+
+    // Gain value of flagged bad pixels
+    constexpr unsigned char BAD_PIXEL_GAIN = 0xFF;
+
+    // Pedestal (mean dark signal) and noise, per gain and pixel
+    class Pedestal {
+       public:
+        Pedestal() : m_pixels(0), m_valid(false){};
+
+        size_t pixels() const {
+            return m_pixels;
+        }
+
+        bool isValid() const {
+            return m_valid;
+        }
+
+        void resize(size_t pixels) {
+            m_pixels = pixels;
+            m_mean.assign(NUMBER_OF_GAINS * pixels, 0.f);
+            m_noise.assign(NUMBER_OF_GAINS * pixels, 0.f);
+            this->reset();
+        }
+
+        // Start a new accumulation
+        void reset() {
+            m_sum.assign(NUMBER_OF_GAINS * m_pixels, 0.);
+            m_sum2.assign(NUMBER_OF_GAINS * m_pixels, 0.);
+            m_count.assign(NUMBER_OF_GAINS * m_pixels, 0);
+            m_valid = false;
+        }
+
+        // Accumulate one frame, each pixel in its own gain (bad pixels, and the excluded ones if given, skipped)
+        void add(const unsigned short* adc, const unsigned char* gain, const unsigned char* excluded = nullptr) {
+            for (size_t i = 0; i < m_pixels; ++i) {
+                if (gain[i] == BAD_PIXEL_GAIN || (excluded != nullptr && excluded[i] != 0)) {
+                    continue;
+                }
+                const size_t idx = (gain[i] & (NUMBER_OF_GAINS - 1)) * m_pixels + i;
+                const double value = adc[i];
+                m_sum[idx] += value;
+                m_sum2[idx] += value * value;
+                m_count[idx] += 1;
+            }
+        }
+
+        // Compute mean and noise from the accumulated frames
+        void finalize() {
+            for (size_t idx = 0; idx < m_sum.size(); ++idx) {
+                if (m_count[idx] > 0) {
+                    const double mean = m_sum[idx] / m_count[idx];
+                    const double variance = m_sum2[idx] / m_count[idx] - mean * mean;
+                    m_mean[idx] = mean;
+                    m_noise[idx] = std::sqrt(std::max(variance, 0.));
+                }
+            }
+            m_valid = true;
+        }
+
+        float mean(unsigned char gain, size_t pixel) const {
+            return m_mean[(gain & (NUMBER_OF_GAINS - 1)) * m_pixels + pixel];
+        }
+
+        float noise(unsigned char gain, size_t pixel) const {
+            return m_noise[(gain & (NUMBER_OF_GAINS - 1)) * m_pixels + pixel];
+        }
+
+       private:
+        size_t m_pixels;
+        bool m_valid;
+
+        std::vector<double> m_sum;
+        std::vector<double> m_sum2;
+        std::vector<unsigned int> m_count;
+
+        std::vector<float> m_mean;
+        std::vector<float> m_noise;
+    };
+
+} /* namespace karabo */
+
+#endif /* KARABO_CORRECTIONS_HH */
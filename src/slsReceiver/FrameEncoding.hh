@@ -0,0 +1,139 @@
+/*
+ * Copyright (c) European XFEL GmbH Schenefeld. All rights reserved.
+ */
+
+#ifndef KARABO_FRAMEENCODING_HH
+#define KARABO_FRAMEENCODING_HH
+
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+/**
+ * The main Karabo namespace
+ */
+namespace karabo {
+
+    enum FrameEncoding : unsigned char { DENSE = 0, SPARSE = 1 };
+
+    /**
+     * The frames of a train, each one either dense (all pixels) or sparse (only the pixels with signal, as
+     * index/value pairs). Values of all frames are concatenated, in frame order.
+     */
+    struct EncodedFrames {
+        std::vector<unsigned char> encoding;  // per frame
+        std::vector<unsigned int> pixelCount; // per frame: number of values stored
+        std::vector<unsigned int> index;      // pixel indices, for sparse frames only
+        std::vector<unsigned short> adc;
+        std::vector<unsigned char> gain;
+
+        void clear() {
+            encoding.clear();
+            pixelCount.clear();
+            index.clear();
+            adc.clear();
+            gain.clear();
+        }
+    };
+
+    /**
+     * Append a frame to the encoded ones. It is stored as sparse if the fraction of pixels with signal is not
+     * larger than maxOccupancy, else as dense.
+     *
+     * @param adc, gain the frame
+     * @param size number of pixels in the frame
+     * @param hasSignal functor, returning true if pixel 'i' has to be kept
+     * @param maxOccupancy maximum fraction of pixels with signal, for sparse encoding
+     * @param encoded the encoded frames
+     */
+    template <class HasSignal>
+    void encodeFrame(const unsigned short* adc, const unsigned char* gain, size_t size, const HasSignal& hasSignal,
+                     float maxOccupancy, EncodedFrames& encoded) {
+        const size_t maxPixels = maxOccupancy * size;
+        const size_t firstIndex = encoded.index.size();
+
+        // Try sparse first, fall back to dense as soon as there are too many pixels with signal
+        bool sparse = true;
+        for (size_t i = 0; i < size; ++i) {
+            if (hasSignal(i)) {
+                if (encoded.index.size() - firstIndex >= maxPixels) {
+                    sparse = false;
+                    break;
+                }
+                encoded.index.push_back(i);
+            }
+        }
+
+        if (sparse) {
+            const size_t pixelCount = encoded.index.size() - firstIndex;
+            encoded.encoding.push_back(SPARSE);
+            encoded.pixelCount.push_back(pixelCount);
+            for (size_t n = firstIndex; n < encoded.index.size(); ++n) {
+                encoded.adc.push_back(adc[encoded.index[n]]);
+                encoded.gain.push_back(gain[encoded.index[n]]);
+            }
+        } else {
+            encoded.index.resize(firstIndex);
+            encoded.encoding.push_back(DENSE);
+            encoded.pixelCount.push_back(size);
+            encoded.adc.insert(encoded.adc.end(), adc, adc + size);
+            encoded.gain.insert(encoded.gain.end(), gain, gain + size);
+        }
+    }
+
+    /**
+     * Decoder for EncodedFrames: pixels not stored in sparse frames are set to 0.
+     */
+    class FrameDecoder {
+       public:
+        FrameDecoder(const EncodedFrames& encoded, size_t size) : m_encoded(encoded), m_size(size) {
+            // Offsets of each frame in the values and in the indices
+            size_t valueOffset = 0;
+            size_t indexOffset = 0;
+            for (size_t frame = 0; frame < encoded.encoding.size(); ++frame) {
+                m_valueOffset.push_back(valueOffset);
+                m_indexOffset.push_back(indexOffset);
+                valueOffset += encoded.pixelCount[frame];
+                if (encoded.encoding[frame] == SPARSE) {
+                    indexOffset += encoded.pixelCount[frame];
+                }
+            }
+            if (valueOffset != encoded.adc.size() || valueOffset != encoded.gain.size() ||
+                indexOffset != encoded.index.size()) {
+                throw std::invalid_argument("FrameDecoder: inconsistent encoded frames");
+            }
+        }
+
+        size_t frames() const {
+            return m_valueOffset.size();
+        }
+
+        void decode(size_t frame, unsigned short* adc, unsigned char* gain) const {
+            const unsigned short* adcValues = m_encoded.adc.data() + m_valueOffset[frame];
+            const unsigned char* gainValues = m_encoded.gain.data() + m_valueOffset[frame];
+
+            if (m_encoded.encoding[frame] == DENSE) {
+                std::memcpy(adc, adcValues, m_size * sizeof(unsigned short));
+                std::memcpy(gain, gainValues, m_size * sizeof(unsigned char));
+            } else {
+                std::memset(adc, 0, m_size * sizeof(unsigned short));
+                std::memset(gain, 0, m_size * sizeof(unsigned char));
+                const unsigned int* index = m_encoded.index.data() + m_indexOffset[frame];
+                for (size_t n = 0; n < m_encoded.pixelCount[frame]; ++n) {
+                    adc[index[n]] = adcValues[n];
+                    gain[index[n]] = gainValues[n];
+                }
+            }
+        }
+
+       private:
+        const EncodedFrames& m_encoded;
+        const size_t m_size;
+        std::vector<size_t> m_valueOffset;
+        std::vector<size_t> m_indexOffset;
+    };
+
+} /* namespace karabo */
+
+#endif /* KARABO_FRAMEENCODING_HH */
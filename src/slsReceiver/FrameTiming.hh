@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) European XFEL GmbH Schenefeld. All rights reserved.
+ */
+
+#ifndef KARABO_FRAMETIMING_HH
+#define KARABO_FRAMETIMING_HH
+
+#include <algorithm>
+#include <cstdint>
+
+/**
+ * The main Karabo namespace
+ */
+namespace karabo {
+
+    // Mapping from frame number to trainId (anchored once per acquisition)
+    struct FrameNumberMapping {
+        FrameNumberMapping()
+            : enable(false),
+              frameNumbersPerTrain(1),
+              resyncInterval(0.),
+              driftTolerance(0),
+              anchored(false),
+              anchorFrameNumber(0),
+              anchorTrainId(0),
+              lastResyncTime(0.),
+              drift(0),
+              maxDrift(0),
+              resyncs(0){};
+
+        bool enable;
+        unsigned int frameNumbersPerTrain;
+        double resyncInterval;
+        unsigned int driftTolerance;
+
+        bool anchored;
+        unsigned long long anchorFrameNumber;
+        unsigned long long anchorTrainId;
+        double lastResyncTime;
+
+        long long drift;    // time server trainId - derived trainId, at the last check
+        long long maxDrift; // in absolute value
+        unsigned int resyncs;
+
+        void reset() {
+            anchored = false;
+            drift = 0;
+            maxDrift = 0;
+            resyncs = 0;
+        }
+
+        unsigned long long getTrainId(unsigned long long frameNumber) const {
+            // Floor division, also for frames preceding the anchor
+            const long long frames = frameNumber - anchorFrameNumber;
+            const long long perTrain = frameNumbersPerTrain;
+            const long long trains = (frames >= 0) ? frames / perTrain : -((-frames + perTrain - 1) / perTrain);
+            return anchorTrainId + trains;
+        }
+    };
+
+    /**
+     * Conversion of the detector timestamp (10 MHz clock) to absolute time.
+     *
+     * The conversion is piecewise linear and continuous: at each calibration, the host time is compared with the
+     * converted time, and the difference (mostly jitter of the host callback) is absorbed gradually by slewing the
+     * rate, instead of making the timestamps jump.
+     */
+    struct DetectorClock {
+        DetectorClock()
+            : enable(false),
+              calibrationInterval(0.),
+              calibrated(false),
+              firstTicks(0),
+              firstTime(0.),
+              anchorTicks(0),
+              anchorTime(0.),
+              baseRate(1.),
+              rate(1.),
+              offset(0.),
+              lastCalibrationTicks(0),
+              lastTicks(0),
+              lastFrameNumber(0),
+              ticksPerFrame(0.){};
+
+        static constexpr double tickPeriod = 1.e-7; // 10 MHz
+        static constexpr double slewIntervals = 4.; // The offset is absorbed over a few calibration intervals
+
+        bool enable;
+        double calibrationInterval;
+
+        bool calibrated;
+        uint64_t firstTicks; // First calibration, for the rate estimation
+        double firstTime;
+        uint64_t anchorTicks; // Start of the current linear segment
+        double anchorTime;
+        double baseRate; // Host seconds per detector second, over the whole baseline
+        double rate;     // The one used for conversion: baseRate, slewed for absorbing the offset
+        double offset;   // Host time - converted detector time, at the last calibration
+        uint64_t lastCalibrationTicks;
+
+        // For the timestamps of frames sharing the same header
+        uint64_t lastTicks;
+        unsigned long long lastFrameNumber;
+        double ticksPerFrame;
+
+        void reset() {
+            calibrated = false;
+            baseRate = 1.;
+            rate = 1.;
+            offset = 0.;
+            lastTicks = 0;
+            lastFrameNumber = 0;
+            ticksPerFrame = 0.;
+        }
+
+        double toTime(double ticks) const {
+            return anchorTime + (ticks - anchorTicks) * tickPeriod * rate;
+        }
+
+        void calibrate(uint64_t ticks, double hostTime) {
+            if (!calibrated || ticks < firstTicks) {
+                // First calibration, or the detector clock has been reset
+                firstTicks = anchorTicks = ticks;
+                firstTime = anchorTime = hostTime;
+                baseRate = rate = 1.;
+                offset = 0.;
+                calibrated = true;
+            } else if (ticks > anchorTicks) {
+                // Drift estimation over the whole baseline, which averages the host jitter out
+                baseRate = (hostTime - firstTime) / ((ticks - firstTicks) * tickPeriod);
+                offset = hostTime - this->toTime(ticks);
+
+                // New segment, starting where the current one is: the timestamps stay continuous
+                const double interval = std::max(calibrationInterval, (ticks - lastCalibrationTicks) * tickPeriod);
+                anchorTime = this->toTime(ticks);
+                anchorTicks = ticks;
+                rate = baseRate + offset / (slewIntervals * interval);
+            }
+            lastCalibrationTicks = ticks;
+        }
+
+        void update(uint64_t ticks, unsigned long long frameNumber) {
+            if (lastFrameNumber != 0 && frameNumber > lastFrameNumber && ticks > lastTicks) {
+                ticksPerFrame = static_cast<double>(ticks - lastTicks) / (frameNumber - lastFrameNumber);
+            }
+            lastTicks = ticks;
+            lastFrameNumber = frameNumber;
+        }
+
+        bool needsCalibration(uint64_t ticks) const {
+            // Not for late frames, preceding the last calibration
+            return !calibrated || ticks < firstTicks ||
+                   (ticks > lastCalibrationTicks && (ticks - lastCalibrationTicks) * tickPeriod > calibrationInterval);
+        }
+    };
+
+} /* namespace karabo */
+
+#endif /* KARABO_FRAMETIMING_HH */
@@ -14,6 +14,12 @@
 #define GOTTHARD2_GAIN_MASK 0x3000
 #define GOTTHARD2_GAIN_OFFSET 12
 
+// Each chip has 128 channels
+#define GOTTHARD2_CHIP_CHANNELS 128
+
+// Master/slave interleaving: max frames waiting for their partner
+#define GOTTHARD2_MAX_PENDING_FRAMES 128
+
 #include "Gotthard2Receiver.hh"
 
 USING_KARABO_NAMESPACES
@@ -23,6 +29,229 @@ namespace karabo {
     KARABO_REGISTER_FOR_CONFIGURATION(Device, SlsReceiver, Gotthard2Receiver)
 
     void Gotthard2Receiver::expectedParameters(Schema& expected) {
+        OVERWRITE_ELEMENT(expected)
+              .key("pipeline.stages")
+              .setNewDefaultValue(std::vector<std::string>{"unpack", "mask", "pedestal", "meanImage", "spectrum",
+                                                            "histogram", "compress", "publish"})
+              .commit();
+
+        NODE_ELEMENT(expected)
+              .key("interleave")
+              .displayedName("Interleave")
+              .description(
+                    "25 um mode: master and slave frames are paired by frame number and interleaved into a single "
+                    "frame, with the master on the even and the slave on the odd channels.")
+              .commit();
+
+        BOOL_ELEMENT(expected)
+              .key("interleave.enable")
+              .displayedName("Enable")
+              .description("Receive the data from both master and slave modules, and interleave them.")
+              .assignmentOptional()
+              .defaultValue(false)
+              .init()
+              .commit();
+
+        UINT16_ELEMENT(expected)
+              .key("interleave.slaveRxTcpPort")
+              .displayedName("Slave rxTcpPort")
+              .description("Receiver TCP Port for the slave module.")
+              .assignmentOptional()
+              .defaultValue(1955)
+              .init()
+              .commit();
+
+        BOOL_ELEMENT(expected)
+              .key("interleave.reverseSlave")
+              .displayedName("Reverse Slave")
+              .description(
+                    "Reverse the channel order of the slave module. Not needed if the slave is already read out "
+                    "in reverse mode.")
+              .assignmentOptional()
+              .defaultValue(false)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        UINT64_ELEMENT(expected)
+              .key("interleave.unpairedFrames")
+              .displayedName("Unpaired Frames")
+              .description("Number of frames, in the last acquisition, for which no partner was received.")
+              .readOnly()
+              .initialValue(0)
+              .commit();
+
+        NODE_ELEMENT(expected)
+              .key("spectrum")
+              .displayedName("Spectrum")
+              .description(
+                    "Integrated spectrum: per-channel sums of the pedestal-subtracted and gain-weighted ADC counts "
+                    "(see 'pedestal' and 'corrections').")
+              .commit();
+
+        BOOL_ELEMENT(expected)
+              .key("spectrum.enable")
+              .displayedName("Enable")
+              .description("Send the integrated spectrum to the 'spectrum' output channel.")
+              .assignmentOptional()
+              .defaultValue(false)
+              .reconfigurable()
+              .commit();
+
+        UINT16_ELEMENT(expected)
+              .key("spectrum.windowSize")
+              .displayedName("Window Size")
+              .description("Number of trains in the sliding window.")
+              .assignmentOptional()
+              .defaultValue(10)
+              .minInc(1)
+              .reconfigurable()
+              .commit();
+
+        Schema spectrumData;
+
+        NODE_ELEMENT(spectrumData).key("data").displayedName("Data").commit();
+
+        VECTOR_DOUBLE_ELEMENT(spectrumData)
+              .key("data.trainSum")
+              .displayedName("Train Sum")
+              .description("Sum over the frames of the train.")
+              .readOnly()
+              .commit();
+
+        VECTOR_DOUBLE_ELEMENT(spectrumData)
+              .key("data.windowSum")
+              .displayedName("Window Sum")
+              .description("Sum over the frames of the sliding window.")
+              .readOnly()
+              .commit();
+
+        VECTOR_DOUBLE_ELEMENT(spectrumData)
+              .key("data.acquisitionSum")
+              .displayedName("Acquisition Sum")
+              .description("Sum over the frames of the acquisition.")
+              .readOnly()
+              .commit();
+
+        UINT32_ELEMENT(spectrumData).key("data.trainFrames").displayedName("Train Frames").readOnly().commit();
+
+        UINT64_ELEMENT(spectrumData).key("data.windowFrames").displayedName("Window Frames").readOnly().commit();
+
+        UINT64_ELEMENT(spectrumData)
+              .key("data.acquisitionFrames")
+              .displayedName("Acquisition Frames")
+              .readOnly()
+              .commit();
+
+        OUTPUT_CHANNEL(expected).key("spectrum").displayedName("Spectrum").dataSchema(spectrumData).commit();
+
+        NODE_ELEMENT(expected)
+              .key("histogram")
+              .displayedName("Histogram")
+              .description("Per-channel ADC histograms, per gain stage, for gain and noise calibration.")
+              .commit();
+
+        BOOL_ELEMENT(expected)
+              .key("histogram.enable")
+              .displayedName("Enable")
+              .description("Fill the histograms with all the frames received. They are reset at every acquisition.")
+              .assignmentOptional()
+              .defaultValue(false)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        UINT16_ELEMENT(expected)
+              .key("histogram.bins")
+              .displayedName("Bins")
+              .assignmentOptional()
+              .defaultValue(1024)
+              .minInc(1)
+              .maxInc(4096)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        UINT16_ELEMENT(expected)
+              .key("histogram.adcMin")
+              .displayedName("ADC Min")
+              .description("Lower edge of the first bin.")
+              .assignmentOptional()
+              .defaultValue(0)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        UINT16_ELEMENT(expected)
+              .key("histogram.binWidth")
+              .displayedName("Bin Width")
+              .description("The bin width, in ADC counts.")
+              .assignmentOptional()
+              .defaultValue(4)
+              .minInc(1)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        UINT16_ELEMENT(expected)
+              .key("histogram.threads")
+              .displayedName("Threads")
+              .description("Number of threads filling the histograms, each one for a range of channels.")
+              .assignmentOptional()
+              .defaultValue(4)
+              .minInc(1)
+              .maxInc(16)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        FLOAT_ELEMENT(expected)
+              .key("histogram.publishInterval")
+              .displayedName("Publish Interval")
+              .description(
+                    "How often the histograms are sent to the 'histogram' output channel. If 0, they are only sent "
+                    "on demand and at the end of the acquisition.")
+              .assignmentOptional()
+              .defaultValue(0.)
+              .minInc(0.)
+              .unit(Unit::SECOND)
+              .reconfigurable()
+              .commit();
+
+        SLOT_ELEMENT(expected)
+              .key("publishHistogram")
+              .displayedName("Publish Histogram")
+              .description("Send the current histograms to the 'histogram' output channel.")
+              .allowedStates(State::PASSIVE, State::ACTIVE)
+              .commit();
+
+        Schema histogramData;
+
+        NODE_ELEMENT(histogramData).key("data").displayedName("Data").commit();
+
+        NDARRAY_ELEMENT(histogramData)
+              .key("data.histogram")
+              .displayedName("Histogram")
+              .description("The histograms, with shape (gain, channel, bin).")
+              .dtype(karabo::data::Types::UINT32)
+              .readOnly()
+              .commit();
+
+        UINT16_ELEMENT(histogramData).key("data.adcMin").displayedName("ADC Min").readOnly().commit();
+
+        UINT16_ELEMENT(histogramData).key("data.binWidth").displayedName("Bin Width").readOnly().commit();
+
+        UINT64_ELEMENT(histogramData).key("data.frames").displayedName("Frames").readOnly().commit();
+
+        UINT64_ELEMENT(histogramData)
+              .key("data.outOfRange")
+              .displayedName("Out of Range")
+              .description("Number of values outside the histogram range.")
+              .readOnly()
+              .commit();
+
+        OUTPUT_CHANNEL(expected).key("histogram").displayedName("Histogram").dataSchema(histogramData).commit();
+
         Schema displayData;
 
         NODE_ELEMENT(displayData).key("data").displayedName("Data").commit();
@@ -43,12 +272,439 @@ namespace karabo {
         OUTPUT_CHANNEL(expected).key("display").displayedName("Display").dataSchema(displayData).commit();
     }
 
-    Gotthard2Receiver::Gotthard2Receiver(const karabo::data::Hash& config) : SlsReceiver(config) {}
+    Gotthard2Receiver::Gotthard2Receiver(const karabo::data::Hash& config)
+        : SlsReceiver(config),
+          m_interleave(config.get<bool>("interleave.enable")),
+          m_reverseSlave(false),
+          m_slaveReceiver(nullptr),
+          m_unpairedFrames(0),
+          m_windowFrames(0),
+          m_acquisitionFrames(0),
+          m_histogramEnable(false),
+          m_histogramBins(0),
+          m_histogramAdcMin(0),
+          m_histogramBinWidth(1),
+          m_histogramThreads(1),
+          m_histogramFrames(0),
+          m_histogramOutOfRange(0),
+          m_lastHistogramTime(0.),
+          m_workerTrain(nullptr),
+          m_workerGeneration(0),
+          m_workersBusy(0),
+          m_workerOutOfRange(0),
+          m_workersStop(false) {
+        KARABO_SLOT(publishHistogram);
+
+        this->registerStage("spectrum", [this](const DetectorData* detectorData, const Timestamp& actualTimestamp) {
+            this->processSpectrum(detectorData, actualTimestamp);
+        });
+        this->registerStage("histogram", [this](const DetectorData* detectorData, const Timestamp& actualTimestamp) {
+            this->processHistogram(detectorData, actualTimestamp);
+        });
+    }
+
+    Gotthard2Receiver::~Gotthard2Receiver() {
+        this->stopHistogramWorkers();
+    }
+
+    void Gotthard2Receiver::initializeDetectorSpecific() {
+        if (!m_interleave) {
+            return;
+        }
+
+        const unsigned short slaveRxTcpPort = this->get<unsigned short>("interleave.slaveRxTcpPort");
+        std::shared_ptr<sls::Receiver> receiver(new sls::Receiver(slaveRxTcpPort));
+
+        // Start and end of acquisition are handled by the master
+        receiver->registerCallBackRawDataReady(slaveRawDataReadyCallBack, static_cast<void*>(this));
+        m_slaveReceiver.swap(receiver);
+
+        m_interleavedFrame.resize(this->getDetectorSize());
+        for (auto* frames : {&m_masterFrames, &m_slaveFrames}) {
+            frames->resize(GOTTHARD2_MAX_PENDING_FRAMES);
+            for (PendingFrame& frame : *frames) {
+                frame.data.resize(GOTTHARD2_CHANNELS);
+            }
+        }
+        KARABO_LOG_INFO << "Slave receiver started on port: " << slaveRxTcpPort;
+    }
+
+    void Gotthard2Receiver::startAcquisitionDetectorSpecific() {
+        std::lock_guard<std::mutex> lock(m_pairMutex);
+        m_reverseSlave = this->get<bool>("interleave.reverseSlave");
+        clearPendingFrames(m_masterFrames);
+        clearPendingFrames(m_slaveFrames);
+        m_unpairedFrames = 0;
+        this->set("interleave.unpairedFrames", 0ull);
+    }
+
+    void Gotthard2Receiver::finishAcquisitionDetectorSpecific() {
+        std::lock_guard<std::mutex> lock(m_pairMutex);
+        // Partners will not arrive any more
+        m_unpairedFrames += clearPendingFrames(m_masterFrames) + clearPendingFrames(m_slaveFrames);
+        this->set("interleave.unpairedFrames", m_unpairedFrames);
+    }
+
+    unsigned long long Gotthard2Receiver::clearPendingFrames(std::vector<PendingFrame>& frames) {
+        unsigned long long pending = 0;
+        for (PendingFrame& frame : frames) {
+            pending += frame.valid;
+            frame.valid = false;
+        }
+        return pending;
+    }
+
+    void Gotthard2Receiver::onRawData(slsDetectorDefs::sls_receiver_header& header,
+                                      const slsDetectorDefs::dataCallbackHeader dataCallbackHeader, char* dataPointer,
+                                      size_t& dataSize) {
+        if (m_interleave) {
+            this->pairFrame(true, header, dataCallbackHeader, dataPointer, dataSize);
+        } else {
+            processRawData(header, dataCallbackHeader, dataPointer, dataSize, static_cast<SlsReceiver*>(this));
+        }
+    }
+
+    void Gotthard2Receiver::slaveRawDataReadyCallBack(slsDetectorDefs::sls_receiver_header& header,
+                                                      const slsDetectorDefs::dataCallbackHeader dataCallbackHeader,
+                                                      char* dataPointer, size_t& dataSize, void* context) {
+        Self* self = static_cast<Self*>(context);
+
+        try {
+            self->pairFrame(false, header, dataCallbackHeader, dataPointer, dataSize);
+        } catch (const std::exception& e) {
+            KARABO_LOG_FRAMEWORK_WARN << "slaveRawDataReadyCallBack: " << e.what();
+        } catch (...) {
+            KARABO_LOG_FRAMEWORK_WARN << "slaveRawDataReadyCallBack: other exception";
+        }
+    }
+
+    void Gotthard2Receiver::pairFrame(bool isMaster, slsDetectorDefs::sls_receiver_header& header,
+                                      const slsDetectorDefs::dataCallbackHeader dataCallbackHeader,
+                                      const char* dataPointer, size_t dataSize) {
+        const size_t moduleFrameSize = sizeof(unsigned short) * GOTTHARD2_CHANNELS;
+        if (dataSize != moduleFrameSize) {
+            this->logWarning("pairFrame: data size (" + data::toString(dataSize) + ") is not the size of one frame (" +
+                             data::toString(moduleFrameSize) + "). Skip data.");
+            return;
+        }
+
+        const unsigned long long frameNumber = header.detHeader.frameNumber;
+        const unsigned short* moduleData = reinterpret_cast<const unsigned short*>(dataPointer);
+
+        // Both receivers' threads end up here: pairing and processing are serialized
+        std::lock_guard<std::mutex> lock(m_pairMutex);
+        const size_t slot = frameNumber % GOTTHARD2_MAX_PENDING_FRAMES;
+        PendingFrame& partner = (isMaster ? m_slaveFrames : m_masterFrames)[slot];
+
+        if (!partner.valid || partner.frameNumber != frameNumber) {
+            // Wait for the partner
+            PendingFrame& frame = (isMaster ? m_masterFrames : m_slaveFrames)[slot];
+            if (frame.valid && frame.frameNumber != frameNumber) {
+                // The slot is reused: the older frame will not be paired any more
+                ++m_unpairedFrames;
+                this->logWarning("pairFrame: no partner received for a " + std::string(isMaster ? "master" : "slave") +
+                                 " frame. Skip!");
+            }
+            frame.header = header;
+            std::copy(moduleData, moduleData + GOTTHARD2_CHANNELS, frame.data.begin());
+            frame.frameNumber = frameNumber;
+            frame.valid = true;
+            return;
+        }
+
+        const unsigned short* master = isMaster ? moduleData : partner.data.data();
+        const unsigned short* slave = isMaster ? partner.data.data() : moduleData;
+        this->interleave(master, slave, m_interleavedFrame.data());
+
+        // The master header is used for the interleaved frame
+        slsDetectorDefs::sls_receiver_header masterHeader = isMaster ? header : partner.header;
+        partner.valid = false;
+
+        char* interleavedPointer = reinterpret_cast<char*>(m_interleavedFrame.data());
+        size_t interleavedSize = sizeof(unsigned short) * m_interleavedFrame.size();
+        processRawData(masterHeader, dataCallbackHeader, interleavedPointer, interleavedSize,
+                       static_cast<SlsReceiver*>(this));
+    }
+
+    void Gotthard2Receiver::interleave(const unsigned short* master, const unsigned short* slave,
+                                       unsigned short* interleaved) {
+        // Master and slave channels alternate. Simple loops, which the compiler vectorizes into unpack/shuffle
+        // instructions
+        if (m_reverseSlave) {
+            const unsigned short* slaveEnd = slave + GOTTHARD2_CHANNELS - 1;
+            for (size_t i = 0; i < GOTTHARD2_CHANNELS; ++i) {
+                interleaved[2 * i] = master[i];
+                interleaved[2 * i + 1] = *(slaveEnd - i);
+            }
+        } else {
+            for (size_t i = 0; i < GOTTHARD2_CHANNELS; ++i) {
+                interleaved[2 * i] = master[i];
+                interleaved[2 * i + 1] = slave[i];
+            }
+        }
+    }
+
+    void Gotthard2Receiver::resetTrainProcessing() {
+        const size_t detectorSize = this->getDetectorSize();
+        m_corrected.assign(detectorSize, 0.f);
+        m_trainSum.assign(detectorSize, 0.);
+        m_windowSum.assign(detectorSize, 0.);
+        m_acquisitionSum.assign(detectorSize, 0.);
+        m_windowTrainSums.clear();
+        m_windowTrainFrames.clear();
+        m_windowFrames = 0;
+        m_acquisitionFrames = 0;
+
+        this->resetHistogram();
+    }
+
+    void Gotthard2Receiver::processSpectrum(const DetectorData* detectorData,
+                                            const karabo::data::Timestamp& actualTimestamp) {
+        if (!this->get<bool>("spectrum.enable")) {
+            return;
+        }
 
-    Gotthard2Receiver::~Gotthard2Receiver() {}
+        const size_t detectorSize = this->getDetectorSize();
+        std::fill(m_trainSum.begin(), m_trainSum.end(), 0.);
+        unsigned int trainFrames = 0;
+        for (size_t frame = 0; frame < detectorData->frameValid.size(); ++frame) {
+            if (detectorData->frameValid[frame] != 0) {
+                this->correctFrame(detectorData, frame, m_corrected.data());
+                for (size_t i = 0; i < detectorSize; ++i) {
+                    m_trainSum[i] += m_corrected[i];
+                }
+                ++trainFrames;
+            }
+        }
+
+        // Sliding window: add the latest train, remove the ones falling out
+        const unsigned short windowSize = this->get<unsigned short>("spectrum.windowSize");
+        m_windowTrainSums.push_back(m_trainSum);
+        m_windowTrainFrames.push_back(trainFrames);
+        m_windowFrames += trainFrames;
+        for (size_t i = 0; i < detectorSize; ++i) {
+            m_windowSum[i] += m_trainSum[i];
+            m_acquisitionSum[i] += m_trainSum[i];
+        }
+        while (m_windowTrainSums.size() > windowSize) {
+            const std::vector<double>& oldest = m_windowTrainSums.front();
+            for (size_t i = 0; i < detectorSize; ++i) {
+                m_windowSum[i] -= oldest[i];
+            }
+            m_windowFrames -= m_windowTrainFrames.front();
+            m_windowTrainSums.pop_front();
+            m_windowTrainFrames.pop_front();
+        }
+        m_acquisitionFrames += trainFrames;
+
+        Hash spectrum;
+        spectrum.set("data.trainSum", m_trainSum);
+        spectrum.set("data.windowSum", m_windowSum);
+        spectrum.set("data.acquisitionSum", m_acquisitionSum);
+        spectrum.set("data.trainFrames", trainFrames);
+        spectrum.set("data.windowFrames", m_windowFrames);
+        spectrum.set("data.acquisitionFrames", m_acquisitionFrames);
+        this->writeChannel("spectrum", spectrum, actualTimestamp);
+    }
+
+    unsigned int Gotthard2Receiver::getCommonModeGroup(size_t pixel) {
+        if (m_interleave) {
+            // Master chips first, then slave ones
+            const unsigned int chips = GOTTHARD2_CHANNELS / GOTTHARD2_CHIP_CHANNELS;
+            const size_t channel = pixel / 2;
+            const unsigned int module = pixel % 2;
+            const size_t moduleChannel = (module == 1 && m_reverseSlave) ? GOTTHARD2_CHANNELS - 1 - channel : channel;
+            return module * chips + moduleChannel / GOTTHARD2_CHIP_CHANNELS;
+        }
+
+        return pixel / GOTTHARD2_CHIP_CHANNELS;
+    }
+
+    void Gotthard2Receiver::flushTrainProcessing() {
+        // Final histograms of the acquisition
+        this->writeHistogram(this->getActualTimestamp());
+        this->stopHistogramWorkers();
+    }
+
+    void Gotthard2Receiver::signalEndOfStreamsDetectorSpecific() {
+        this->signalEndOfStream("spectrum");
+        this->signalEndOfStream("histogram");
+    }
+
+    void Gotthard2Receiver::publishHistogram() {
+        // Histograms are only accessed in the strand
+        m_strand->post(karabo::util::bind_weak(&Gotthard2Receiver::writeHistogram, this, this->getActualTimestamp()));
+    }
+
+    void Gotthard2Receiver::processHistogram(const DetectorData* detectorData,
+                                             const karabo::data::Timestamp& actualTimestamp) {
+        if (!m_histogramEnable) {
+            return;
+        }
+
+        this->fillHistogram(detectorData);
+
+        const float publishInterval = this->get<float>("histogram.publishInterval");
+        const double currentTime = actualTimestamp.toTimestamp();
+        if (publishInterval > 0. && currentTime - m_lastHistogramTime >= publishInterval) {
+            this->writeHistogram(actualTimestamp);
+            m_lastHistogramTime = currentTime;
+        }
+    }
+
+    void Gotthard2Receiver::resetHistogram() {
+        m_histogramEnable = this->get<bool>("histogram.enable");
+        m_histogramBins = this->get<unsigned short>("histogram.bins");
+        m_histogramAdcMin = this->get<unsigned short>("histogram.adcMin");
+        m_histogramBinWidth = this->get<unsigned short>("histogram.binWidth");
+        m_histogramThreads = this->get<unsigned short>("histogram.threads");
+        m_histogramFrames = 0;
+        m_histogramOutOfRange = 0;
+        m_lastHistogramTime = this->getActualTimestamp().toTimestamp();
+
+        this->stopHistogramWorkers();
+        if (m_histogramEnable) {
+            m_histogram.assign(NUMBER_OF_GAINS * this->getDetectorSize() * m_histogramBins, 0);
+            this->startHistogramWorkers();
+        } else {
+            std::vector<unsigned int>().swap(m_histogram); // Free memory
+        }
+    }
+
+    void Gotthard2Receiver::fillHistogram(const DetectorData* detectorData) {
+        // Each thread fills the histograms of a range of channels: they are contiguous in memory, and no merging
+        // is needed. The first range is filled by the calling thread.
+        const size_t detectorSize = this->getDetectorSize();
+        const size_t channelsPerThread = (detectorSize + m_histogramThreads - 1) / m_histogramThreads;
+        const size_t firstRangeEnd = m_histogramWorkers.empty() ? detectorSize : channelsPerThread;
+
+        if (!m_histogramWorkers.empty()) {
+            std::lock_guard<std::mutex> lock(m_workerMutex);
+            m_workerTrain = detectorData;
+            m_workersBusy = m_histogramWorkers.size();
+            m_workerOutOfRange = 0;
+            ++m_workerGeneration;
+        }
+        m_workerStart.notify_all();
+
+        unsigned long long outOfRange = this->fillHistogramChannels(detectorData, 0, firstRangeEnd);
+        {
+            std::unique_lock<std::mutex> lock(m_workerMutex);
+            m_workerDone.wait(lock, [this]() { return m_workersBusy == 0; });
+            outOfRange += m_workerOutOfRange;
+        }
+
+        m_histogramOutOfRange += outOfRange;
+        m_histogramFrames += std::count(detectorData->frameValid.begin(), detectorData->frameValid.end(), 1);
+    }
+
+    void Gotthard2Receiver::startHistogramWorkers() {
+        const size_t detectorSize = this->getDetectorSize();
+        const size_t channelsPerThread = (detectorSize + m_histogramThreads - 1) / m_histogramThreads;
+
+        std::lock_guard<std::mutex> lock(m_workerMutex);
+        m_workersStop = false;
+        m_workersBusy = 0;
+        for (size_t firstChannel = channelsPerThread; firstChannel < detectorSize; firstChannel += channelsPerThread) {
+            const size_t lastChannel = std::min(firstChannel + channelsPerThread, detectorSize);
+            m_histogramWorkers.emplace_back(&Gotthard2Receiver::runHistogramWorker, this, firstChannel, lastChannel,
+                                            m_workerGeneration);
+        }
+    }
+
+    void Gotthard2Receiver::stopHistogramWorkers() {
+        {
+            std::lock_guard<std::mutex> lock(m_workerMutex);
+            m_workersStop = true;
+        }
+        m_workerStart.notify_all();
+        for (std::thread& worker : m_histogramWorkers) {
+            worker.join();
+        }
+        m_histogramWorkers.clear();
+    }
+
+    void Gotthard2Receiver::runHistogramWorker(size_t firstChannel, size_t lastChannel,
+                                               unsigned long long generation) {
+        this->placeThread(ThreadRole::worker);
+
+        // The generation is the one at start: a train given before the worker waits is not missed
+        std::unique_lock<std::mutex> lock(m_workerMutex);
+        while (true) {
+            m_workerStart.wait(lock, [this, &generation]() {
+                return m_workersStop || m_workerGeneration != generation;
+            });
+            if (m_workersStop) {
+                return;
+            }
+            generation = m_workerGeneration;
+            const DetectorData* detectorData = m_workerTrain;
+
+            lock.unlock();
+            const unsigned long long outOfRange = this->fillHistogramChannels(detectorData, firstChannel, lastChannel);
+            lock.lock();
+
+            m_workerOutOfRange += outOfRange;
+            if (--m_workersBusy == 0) {
+                m_workerDone.notify_one();
+            }
+        }
+    }
+
+    unsigned long long Gotthard2Receiver::fillHistogramChannels(const DetectorData* detectorData, size_t firstChannel,
+                                                                size_t lastChannel) {
+        const size_t detectorSize = this->getDetectorSize();
+        const unsigned int bins = m_histogramBins;
+        const unsigned int adcMin = m_histogramAdcMin;
+        const unsigned int binWidth = m_histogramBinWidth;
+        unsigned int* histogram = m_histogram.data();
+        unsigned long long outOfRange = 0;
+        const unsigned char* zeroed = this->getZeroedPixels();
+
+        for (size_t frame = 0; frame < detectorData->frameValid.size(); ++frame) {
+            if (detectorData->frameValid[frame] == 0) {
+                continue;
+            }
+            const unsigned short* adc = detectorData->adc + frame * detectorSize;
+            const unsigned char* gain = detectorData->gain + frame * detectorSize;
+            for (size_t ch = firstChannel; ch < lastChannel; ++ch) {
+                if (gain[ch] == BAD_PIXEL_GAIN || (zeroed != nullptr && zeroed[ch] != 0)) {
+                    continue;
+                }
+                // Values below adcMin wrap around, and are out of range as well
+                const unsigned int bin = (adc[ch] - adcMin) / binWidth;
+                if (adc[ch] >= adcMin && bin < bins) {
+                    const size_t g = gain[ch] & (NUMBER_OF_GAINS - 1);
+                    histogram[(g * detectorSize + ch) * bins + bin] += 1;
+                } else {
+                    ++outOfRange;
+                }
+            }
+        }
+
+        return outOfRange;
+    }
+
+    void Gotthard2Receiver::writeHistogram(const karabo::data::Timestamp& actualTimestamp) {
+        if (!m_histogramEnable) {
+            return;
+        }
+
+        const Dims shape(NUMBER_OF_GAINS, this->getDetectorSize(), m_histogramBins);
+        NDArray histogramData(m_histogram.data(), m_histogram.size(), NDArray::NullDeleter(), shape); // No-copy
+
+        Hash histogram;
+        histogram.set("data.histogram", histogramData);
+        histogram.set("data.adcMin", m_histogramAdcMin);
+        histogram.set("data.binWidth", m_histogramBinWidth);
+        histogram.set("data.frames", m_histogramFrames);
+        histogram.set("data.outOfRange", m_histogramOutOfRange);
+        this->writeChannel("histogram", histogram, actualTimestamp);
+    }
 
     size_t Gotthard2Receiver::getDetectorSize() {
-        return GOTTHARD2_CHANNELS;
+        // Master and slave channels are interleaved in 25 um mode
+        return m_interleave ? 2 * GOTTHARD2_CHANNELS : GOTTHARD2_CHANNELS;
     }
 
     std::vector<unsigned long long> Gotthard2Receiver::getDisplayShape() {
@@ -9,7 +9,11 @@
 #ifndef KARABO_GOTTHARD2RECEIVER_HH
 #define KARABO_GOTTHARD2RECEIVER_HH
 
+#include <condition_variable>
+#include <deque>
 #include <karabo/karabo.hpp>
+#include <mutex>
+#include <thread>
 
 #include "../common/version.hh" // provides SLSDETECTORS_PACKAGE_VERSION
 #include "SlsReceiver.hh"
@@ -44,7 +48,50 @@ namespace karabo {
         virtual ~Gotthard2Receiver();
 
        private: // State-machine call-backs (override)
+       private: // Slots
+        void publishHistogram();
+
        private: // Functions
+        void initializeDetectorSpecific() override;
+        void startAcquisitionDetectorSpecific() override;
+        void finishAcquisitionDetectorSpecific() override;
+
+        // Master/slave interleaving (25 um mode)
+        void onRawData(slsDetectorDefs::sls_receiver_header& header,
+                       const slsDetectorDefs::dataCallbackHeader dataCallbackHeader, char* dataPointer,
+                       size_t& dataSize) override;
+
+        static void slaveRawDataReadyCallBack(slsDetectorDefs::sls_receiver_header& header,
+                                              const slsDetectorDefs::dataCallbackHeader, char* dataPointer,
+                                              size_t& dataSize, void* context);
+
+        void pairFrame(bool isMaster, slsDetectorDefs::sls_receiver_header& header,
+                       const slsDetectorDefs::dataCallbackHeader dataCallbackHeader, const char* dataPointer,
+                       size_t dataSize);
+
+        void interleave(const unsigned short* master, const unsigned short* slave, unsigned short* interleaved);
+
+        // Integrated spectrum
+        void resetTrainProcessing() override;
+        void processSpectrum(const DetectorData* detectorData, const karabo::data::Timestamp& actualTimestamp);
+        void flushTrainProcessing() override;
+        void signalEndOfStreamsDetectorSpecific() override;
+
+        unsigned int getCommonModeGroup(size_t pixel) override;
+
+        // Per-channel ADC histograms
+        void resetHistogram();
+        void processHistogram(const DetectorData* detectorData, const karabo::data::Timestamp& actualTimestamp);
+        void fillHistogram(const DetectorData* detectorData);
+
+        // Worker pool filling the histograms, started and pinned once per acquisition
+        void startHistogramWorkers();
+        void stopHistogramWorkers();
+        void runHistogramWorker(size_t firstChannel, size_t lastChannel, unsigned long long generation);
+        unsigned long long fillHistogramChannels(const DetectorData* detectorData, size_t firstChannel,
+                                                 size_t lastChannel);
+        void writeHistogram(const karabo::data::Timestamp& actualTimestamp);
+
        private: // Raw data unpacking
         size_t getDetectorSize() override;
         std::vector<unsigned long long> getDisplayShape() override;
@@ -53,6 +100,60 @@ namespace karabo {
         void unpackRawData(const char* data, size_t idx, unsigned short* adc, unsigned char* gain) override;
 
        private: // Members
+        struct PendingFrame {
+            slsDetectorDefs::sls_receiver_header header;
+            std::vector<unsigned short> data;
+            unsigned long long frameNumber = 0;
+            bool valid = false;
+        };
+
+        // Invalidate the frames waiting for their partner, and return how many they were
+        static unsigned long long clearPendingFrames(std::vector<PendingFrame>& frames);
+
+        const bool m_interleave;
+        bool m_reverseSlave;
+
+        // Second sls receiver, for the slave module
+        std::shared_ptr<sls::Receiver> m_slaveReceiver;
+
+        // Frames waiting for their partner: preallocated rings, indexed by frame number
+        std::mutex m_pairMutex;
+        std::vector<PendingFrame> m_masterFrames;
+        std::vector<PendingFrame> m_slaveFrames;
+        std::vector<unsigned short> m_interleavedFrame;
+        unsigned long long m_unpairedFrames;
+
+        // Integrated spectrum: per train, over a sliding window of trains, and over the acquisition
+        std::vector<float> m_corrected;
+        std::vector<double> m_trainSum;
+        std::vector<double> m_windowSum;
+        std::vector<double> m_acquisitionSum;
+        std::deque<std::vector<double>> m_windowTrainSums;
+        std::deque<unsigned int> m_windowTrainFrames;
+        unsigned long long m_windowFrames;
+        unsigned long long m_acquisitionFrames;
+
+        // Per-channel ADC histograms, with layout [gain][channel][bin]
+        bool m_histogramEnable;
+        unsigned short m_histogramBins;
+        unsigned short m_histogramAdcMin;
+        unsigned short m_histogramBinWidth;
+        unsigned short m_histogramThreads;
+        std::vector<unsigned int> m_histogram;
+        unsigned long long m_histogramFrames;
+        unsigned long long m_histogramOutOfRange;
+        double m_lastHistogramTime;
+
+        // Histogram workers: each one fills a range of channels of the train given at every generation
+        std::vector<std::thread> m_histogramWorkers;
+        std::mutex m_workerMutex;
+        std::condition_variable m_workerStart;
+        std::condition_variable m_workerDone;
+        const DetectorData* m_workerTrain;
+        unsigned long long m_workerGeneration;
+        size_t m_workersBusy;
+        unsigned long long m_workerOutOfRange;
+        bool m_workersStop;
     };
 
 } /* namespace karabo */
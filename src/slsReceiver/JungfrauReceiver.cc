@@ -9,6 +9,11 @@
 #define JUNGFRAU_PIXEL_X (4 * 256)
 #define JUNGFRAU_PIXEL_Y (2 * 256)
 
+#define JUNGFRAU_STORAGE_CELLS 16
+
+// Each ASIC has 256x256 pixels
+#define JUNGFRAU_ASIC_PIXELS 256
+
 // Junfrau raw data: unpacking adc/gain bytes
 #define JUNGFRAU_ADC_MASK 0x3FFF
 #define JUNGFRAU_GAIN_MASK 0xC000
@@ -23,6 +28,12 @@ namespace karabo {
     KARABO_REGISTER_FOR_CONFIGURATION(Device, SlsReceiver, JungfrauReceiver)
 
     void JungfrauReceiver::expectedParameters(Schema& expected) {
+        OVERWRITE_ELEMENT(expected)
+              .key("pipeline.stages")
+              .setNewDefaultValue(std::vector<std::string>{"unpack", "mask", "pedestal", "meanImage", "clusters",
+                                                            "compress", "publish"})
+              .commit();
+
         Schema displayData;
 
         NODE_ELEMENT(displayData).key("data").displayedName("Data").commit();
@@ -71,9 +82,122 @@ namespace karabo {
               .reconfigurable()
               .allowedStates(State::PASSIVE)
               .commit();
+
+        BOOL_ELEMENT(expected)
+              .key("storageCellOrder")
+              .displayedName("Storage Cell Order")
+              .description(
+                    "In burst mode, store each frame at the position of its storage cell in the train, "
+                    "relative to the storage cell start, instead of in arrival order. "
+                    "Missing storage cells will have 'data.frameValid' set to 0.")
+              .assignmentOptional()
+              .defaultValue(false)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        STRING_ELEMENT(expected)
+              .key("commonMode.region")
+              .displayedName("Region")
+              .description("The pixels sharing the same common mode: a whole ASIC (256x256), or a row of an ASIC.")
+              .assignmentOptional()
+              .defaultValue("asic")
+              .options(std::vector<std::string>{"asic", "row"})
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        NODE_ELEMENT(expected)
+              .key("clusters")
+              .displayedName("Clusters")
+              .description(
+                    "Cluster finding: pixels above threshold, after pedestal subtraction, which are the maximum of "
+                    "their 3x3 neighbourhood, are sent as a sparse list to the 'clusters' output channel. "
+                    "It requires a valid pedestal.")
+              .commit();
+
+        BOOL_ELEMENT(expected)
+              .key("clusters.enable")
+              .displayedName("Enable")
+              .assignmentOptional()
+              .defaultValue(false)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        FLOAT_ELEMENT(expected)
+              .key("clusters.threshold")
+              .displayedName("Threshold")
+              .description("The threshold, in units of the pixel noise.")
+              .assignmentOptional()
+              .defaultValue(5.f)
+              .minExc(0.f)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        UINT32_ELEMENT(expected)
+              .key("clusters.maxClusters")
+              .displayedName("Max Clusters")
+              .description("Maximum number of clusters per train. Further clusters are discarded.")
+              .assignmentOptional()
+              .defaultValue(100000)
+              .minInc(1)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        Schema clusterData;
+
+        NODE_ELEMENT(clusterData).key("data").displayedName("Data").commit();
+
+        VECTOR_UINT16_ELEMENT(clusterData)
+              .key("data.frame")
+              .displayedName("Frame")
+              .description("The index of the frame in the train.")
+              .readOnly()
+              .commit();
+
+        VECTOR_UINT16_ELEMENT(clusterData).key("data.x").displayedName("X").readOnly().commit();
+
+        VECTOR_UINT16_ELEMENT(clusterData).key("data.y").displayedName("Y").readOnly().commit();
+
+        VECTOR_FLOAT_ELEMENT(clusterData)
+              .key("data.energy")
+              .displayedName("Energy")
+              .description("The signal of the central pixel, in gain 0 ADC counts.")
+              .readOnly()
+              .commit();
+
+        VECTOR_FLOAT_ELEMENT(clusterData)
+              .key("data.clusterSum")
+              .displayedName("Cluster Sum")
+              .description("The signal summed over the 3x3 cluster, in gain 0 ADC counts.")
+              .readOnly()
+              .commit();
+
+        UINT32_ELEMENT(clusterData).key("data.clusters").displayedName("Clusters").readOnly().commit();
+
+        BOOL_ELEMENT(clusterData)
+              .key("data.truncated")
+              .displayedName("Truncated")
+              .description("The maximum number of clusters was reached: the rest of the train was not processed.")
+              .readOnly()
+              .commit();
+
+        OUTPUT_CHANNEL(expected).key("clusters").displayedName("Clusters").dataSchema(clusterData).commit();
     }
 
-    JungfrauReceiver::JungfrauReceiver(const karabo::data::Hash& config) : SlsReceiver(config) {}
+    JungfrauReceiver::JungfrauReceiver(const karabo::data::Hash& config)
+        : SlsReceiver(config),
+          m_commonModeRows(false),
+          m_clusterThreshold(0.f),
+          m_maxClusters(0),
+          m_noNoiseWarned(false) {
+        this->registerStage("clusters", [this](const DetectorData* detectorData, const Timestamp& actualTimestamp) {
+            this->processClusters(detectorData, actualTimestamp);
+        });
+    }
 
     JungfrauReceiver::~JungfrauReceiver() {}
 
@@ -105,6 +229,152 @@ namespace karabo {
         return memoryCell;
     }
 
+    int JungfrauReceiver::getFrameSlot(unsigned char memoryCell) {
+        if (this->get<bool>("burstMode") && this->get<bool>("storageCellOrder")) {
+            // Storage cells are used in the order storageCellStart, storageCellStart+1, ..., 15, 0, 1, ...
+            const auto storageCellStart = this->get<short>("storageCellStart");
+            return (memoryCell - storageCellStart + JUNGFRAU_STORAGE_CELLS) % JUNGFRAU_STORAGE_CELLS;
+        }
+
+        // Arrival order
+        return -1;
+    }
+
+    void JungfrauReceiver::startAcquisitionDetectorSpecific() {
+        m_commonModeRows = (this->get<std::string>("commonMode.region") == "row");
+    }
+
+    void JungfrauReceiver::resetTrainProcessing() {
+        m_clusterThreshold = this->get<float>("clusters.threshold");
+        m_maxClusters = this->get<unsigned int>("clusters.maxClusters");
+        m_noNoiseWarned = false;
+    }
+
+    void JungfrauReceiver::signalEndOfStreamsDetectorSpecific() {
+        this->signalEndOfStream("clusters");
+    }
+
+    void JungfrauReceiver::processClusters(const DetectorData* detectorData,
+                                           const karabo::data::Timestamp& actualTimestamp) {
+        if (!this->get<bool>("clusters.enable")) {
+            return;
+        } else if (!m_pedestal.isValid() || m_pedestal.pixels() != this->getDetectorSize()) {
+            this->logWarning("processClusters: no valid pedestal, clusters cannot be found.");
+            return;
+        }
+
+        m_corrected.resize(this->getDetectorSize());
+        m_clusterFrame.clear();
+        m_clusterX.clear();
+        m_clusterY.clear();
+        m_clusterEnergy.clear();
+        m_clusterSum.clear();
+
+        bool truncated = false;
+        for (unsigned short frame = 0; frame < detectorData->frameValid.size() && !truncated; ++frame) {
+            if (detectorData->frameValid[frame] != 0) {
+                this->correctFrame(detectorData, frame, m_corrected.data());
+                truncated = !this->findClusters(detectorData, frame, m_corrected.data());
+            }
+        }
+        if (truncated) {
+            this->logWarning("processClusters: more than " + karabo::data::toString(m_maxClusters) +
+                             " clusters in the train, the rest of the train is skipped.");
+        }
+
+        Hash clusters;
+        clusters.set("data.frame", m_clusterFrame);
+        clusters.set("data.x", m_clusterX);
+        clusters.set("data.y", m_clusterY);
+        clusters.set("data.energy", m_clusterEnergy);
+        clusters.set("data.clusterSum", m_clusterSum);
+        clusters.set("data.clusters", static_cast<unsigned int>(m_clusterFrame.size()));
+        clusters.set("data.truncated", truncated);
+        this->writeChannel("clusters", clusters, actualTimestamp);
+    }
+
+    bool JungfrauReceiver::findClusters(const DetectorData* detectorData, unsigned short frame,
+                                        const float* corrected) {
+        const unsigned char* gain = detectorData->gain + frame * this->getDetectorSize();
+
+        for (int y = 0; y < JUNGFRAU_PIXEL_Y; ++y) {
+            for (int x = 0; x < JUNGFRAU_PIXEL_X; ++x) {
+                const size_t i = y * JUNGFRAU_PIXEL_X + x;
+                const float value = corrected[i];
+                if (value <= 0.f) {
+                    continue; // Most pixels only hold the pedestal
+                }
+
+                // Per-pixel threshold, in the same units as the corrected value
+                const unsigned char g = gain[i] & (NUMBER_OF_GAINS - 1);
+                const float noise = m_pedestal.noise(g, i) * m_relativeGain[g];
+                if (noise <= 0.f) {
+                    // No pedestal in this gain stage (e.g. only taken in dynamic gain): the pixel cannot seed
+                    if (!m_noNoiseWarned) {
+                        m_noNoiseWarned = true;
+                        KARABO_LOG_FRAMEWORK_WARN << "findClusters: no noise for pixels in gain "
+                                                  << static_cast<unsigned int>(g)
+                                                  << ", they will not seed clusters. Take a pedestal in that gain.";
+                    }
+                    continue;
+                } else if (value <= m_clusterThreshold * noise) {
+                    continue;
+                }
+
+                // Local maximum of the 3x3 neighbourhood (ties go to the first pixel in raster order)
+                bool isMaximum = true;
+                float clusterSum = 0.f;
+                for (int dy = -1; dy <= 1 && isMaximum; ++dy) {
+                    const int ny = y + dy;
+                    if (ny < 0 || ny >= JUNGFRAU_PIXEL_Y) {
+                        continue;
+                    }
+                    for (int dx = -1; dx <= 1; ++dx) {
+                        const int nx = x + dx;
+                        if (nx < 0 || nx >= JUNGFRAU_PIXEL_X) {
+                            continue;
+                        }
+                        const float neighbour = corrected[ny * JUNGFRAU_PIXEL_X + nx];
+                        const bool before = (dy < 0 || (dy == 0 && dx < 0));
+                        if ((before && neighbour >= value) || (!before && neighbour > value)) {
+                            isMaximum = false;
+                            break;
+                        }
+                        clusterSum += neighbour;
+                    }
+                }
+                if (!isMaximum) {
+                    continue;
+                }
+
+                if (m_clusterFrame.size() >= m_maxClusters) {
+                    return false;
+                }
+                m_clusterFrame.push_back(frame);
+                m_clusterX.push_back(x);
+                m_clusterY.push_back(y);
+                m_clusterEnergy.push_back(value);
+                m_clusterSum.push_back(clusterSum);
+            }
+        }
+        return true;
+    }
+
+    unsigned int JungfrauReceiver::getCommonModeGroup(size_t pixel) {
+        const unsigned int x = pixel % JUNGFRAU_PIXEL_X;
+        const unsigned int y = pixel / JUNGFRAU_PIXEL_X;
+        const unsigned int asicsPerRow = JUNGFRAU_PIXEL_X / JUNGFRAU_ASIC_PIXELS;
+        const unsigned int asicColumn = x / JUNGFRAU_ASIC_PIXELS;
+
+        if (m_commonModeRows) {
+            // Row of an ASIC
+            return y * asicsPerRow + asicColumn;
+        }
+
+        // Whole ASIC
+        return (y / JUNGFRAU_ASIC_PIXELS) * asicsPerRow + asicColumn;
+    }
+
     size_t JungfrauReceiver::getDetectorSize() {
         return JUNGFRAU_PIXEL_X * JUNGFRAU_PIXEL_Y;
     }
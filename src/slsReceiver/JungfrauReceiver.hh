@@ -47,6 +47,18 @@ namespace karabo {
        private: // Functions
         virtual bool isNewTrain(const karabo::data::Hash& meta) override;
         virtual unsigned char getMemoryCell(const slsDetectorDefs::sls_detector_header& detectorHeader) override;
+        virtual int getFrameSlot(unsigned char memoryCell) override;
+
+        void startAcquisitionDetectorSpecific() override;
+
+        // Cluster finding
+        void resetTrainProcessing() override;
+        void signalEndOfStreamsDetectorSpecific() override;
+        void processClusters(const DetectorData* detectorData, const karabo::data::Timestamp& actualTimestamp);
+        // Returns false if the maximum number of clusters is reached
+        bool findClusters(const DetectorData* detectorData, unsigned short frame, const float* corrected);
+
+        unsigned int getCommonModeGroup(size_t pixel) override;
 
        private: // Raw data unpacking
         size_t getDetectorSize() override;
@@ -56,6 +68,19 @@ namespace karabo {
         void unpackRawData(const char* data, size_t idx, unsigned short* adc, unsigned char* gain) override;
 
        private: // Members
+        // Common mode per ASIC row, instead of per ASIC
+        bool m_commonModeRows;
+
+        // Cluster finding: corrected frame, and sparse output of the current train
+        float m_clusterThreshold;
+        unsigned int m_maxClusters;
+        bool m_noNoiseWarned; // Once per acquisition
+        std::vector<float> m_corrected;
+        std::vector<unsigned short> m_clusterFrame;
+        std::vector<unsigned short> m_clusterX;
+        std::vector<unsigned short> m_clusterY;
+        std::vector<float> m_clusterEnergy;
+        std::vector<float> m_clusterSum;
     };
 
 } /* namespace karabo */
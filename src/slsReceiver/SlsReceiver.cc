@@ -9,6 +9,9 @@
 
 #include "SlsReceiver.hh"
 
+#include <algorithm>
+#include <fstream>
+
 USING_KARABO_NAMESPACES
 
 namespace karabo {
@@ -44,6 +47,541 @@ namespace karabo {
               .allowedStates(State::PASSIVE)
               .commit();
 
+        UINT16_ELEMENT(expected)
+              .key("chunkSize")
+              .displayedName("Chunk Size")
+              .description(
+                    "If larger than 0, trains are sent to the PP output channel in chunks of this number of frames, "
+                    "as soon as they are complete. The DAQ output channel always receives the whole train.")
+              .assignmentOptional()
+              .defaultValue(0)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        UINT16_ELEMENT(expected)
+              .key("reorderWindow")
+              .displayedName("Reorder Window")
+              .description(
+                    "How many trains are kept open for receiving data. Frames arriving late are stored in their own "
+                    "train, as long as it is still in the window. With a window of 1, late frames are stored in the "
+                    "current train.")
+              .assignmentOptional()
+              .defaultValue(1)
+              .minInc(1)
+              .maxInc(16)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        FLOAT_ELEMENT(expected)
+              .key("reorderTimeout")
+              .displayedName("Reorder Timeout")
+              .description(
+                    "A train which is not the latest one is sent to the output channels, if it has not received "
+                    "any frame within this time. Only used if the reorder window is larger than 1.")
+              .assignmentOptional()
+              .defaultValue(0.2)
+              .minInc(0.)
+              .unit(Unit::SECOND)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        NODE_ELEMENT(expected)
+              .key("frameNumberMapping")
+              .displayedName("Frame Number Mapping")
+              .description(
+                    "Used when the firmware does not provide the bunchId. The trainId is derived from the frame "
+                    "number, after having been anchored to the time server at the first frame of the acquisition.")
+              .commit();
+
+        BOOL_ELEMENT(expected)
+              .key("frameNumberMapping.enable")
+              .displayedName("Enable")
+              .description("Derive the trainId from the frame number, instead of asking the time server each frame.")
+              .assignmentOptional()
+              .defaultValue(false)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        UINT32_ELEMENT(expected)
+              .key("frameNumberMapping.frameNumbersPerTrain")
+              .displayedName("Frame Numbers per Train")
+              .description(
+                    "How much the frame number increases in one train, i.e. the train period divided by the frame "
+                    "period (e.g. the number of frames per trigger).")
+              .assignmentOptional()
+              .defaultValue(1)
+              .minInc(1)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        FLOAT_ELEMENT(expected)
+              .key("frameNumberMapping.resyncInterval")
+              .displayedName("Resync Interval")
+              .description("How often the derived trainId is compared with the one from the time server.")
+              .assignmentOptional()
+              .defaultValue(10.)
+              .minInc(1.)
+              .unit(Unit::SECOND)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        UINT32_ELEMENT(expected)
+              .key("frameNumberMapping.driftTolerance")
+              .displayedName("Drift Tolerance")
+              .description(
+                    "The mapping is re-anchored when the derived trainId and the one from the time server differ by "
+                    "more than this number of trains. The default tolerates the time server jitter at train "
+                    "boundaries.")
+              .assignmentOptional()
+              .defaultValue(1)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        INT64_ELEMENT(expected)
+              .key("frameNumberMapping.drift")
+              .displayedName("Drift")
+              .description("Time server trainId minus derived trainId, at the last check.")
+              .readOnly()
+              .initialValue(0)
+              .commit();
+
+        INT64_ELEMENT(expected)
+              .key("frameNumberMapping.maxDrift")
+              .displayedName("Max Drift")
+              .description("Largest drift (in absolute value) in the current acquisition.")
+              .readOnly()
+              .initialValue(0)
+              .commit();
+
+        UINT32_ELEMENT(expected)
+              .key("frameNumberMapping.resyncs")
+              .displayedName("Resyncs")
+              .description("How many times the mapping has been re-anchored in the current acquisition.")
+              .readOnly()
+              .initialValue(0)
+              .commit();
+
+        NODE_ELEMENT(expected)
+              .key("detectorClock")
+              .displayedName("Detector Clock")
+              .description(
+                    "The frame timestamps can be taken from the detector header (10 MHz clock), converted to "
+                    "absolute time with a calibrated offset and drift.")
+              .commit();
+
+        BOOL_ELEMENT(expected)
+              .key("detectorClock.enable")
+              .displayedName("Enable")
+              .description(
+                    "Use the detector clock for 'data.timestamp', instead of the host time at the reception of "
+                    "the data.")
+              .assignmentOptional()
+              .defaultValue(false)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        FLOAT_ELEMENT(expected)
+              .key("detectorClock.calibrationInterval")
+              .displayedName("Calibration Interval")
+              .description("How often (in detector time) the detector clock is compared with the host clock.")
+              .assignmentOptional()
+              .defaultValue(10.)
+              .minInc(1.)
+              .unit(Unit::SECOND)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        DOUBLE_ELEMENT(expected)
+              .key("detectorClock.offset")
+              .displayedName("Offset")
+              .description(
+                    "Host time minus converted detector time, at the last calibration. It is absorbed gradually, "
+                    "such that the timestamps stay continuous.")
+              .unit(Unit::SECOND)
+              .readOnly()
+              .initialValue(0.)
+              .commit();
+
+        DOUBLE_ELEMENT(expected)
+              .key("detectorClock.drift")
+              .displayedName("Drift")
+              .description("Estimated drift of the detector clock w.r.t. the host clock, in parts per million.")
+              .readOnly()
+              .initialValue(0.)
+              .commit();
+
+        UINT64_ELEMENT(expected)
+              .key("lateFrames")
+              .displayedName("Late Frames")
+              .description("Number of frames, received in the current acquisition after a newer train had started.")
+              .readOnly()
+              .initialValue(0)
+              .commit();
+
+        UINT64_ELEMENT(expected)
+              .key("misplacedFrames")
+              .displayedName("Misplaced Frames")
+              .description(
+                    "Number of late frames, received in the current acquisition, whose train was already sent. "
+                    "They are discarded if the reorder window is larger than 1, else stored in the current train.")
+              .readOnly()
+              .initialValue(0)
+              .commit();
+
+        NODE_ELEMENT(expected)
+              .key("pedestal")
+              .displayedName("Pedestal")
+              .description("The pedestal is acquired per pixel and gain, from dark frames.")
+              .commit();
+
+        UINT32_ELEMENT(expected)
+              .key("pedestal.frames")
+              .displayedName("Frames")
+              .description("Number of frames to be used for the pedestal.")
+              .assignmentOptional()
+              .defaultValue(1000)
+              .minInc(1)
+              .reconfigurable()
+              .commit();
+
+        UINT32_ELEMENT(expected)
+              .key("pedestal.acquiredFrames")
+              .displayedName("Acquired Frames")
+              .readOnly()
+              .initialValue(0)
+              .commit();
+
+        BOOL_ELEMENT(expected)
+              .key("pedestal.valid")
+              .displayedName("Valid")
+              .description("True when the pedestal acquisition is complete.")
+              .readOnly()
+              .initialValue(false)
+              .commit();
+
+        SLOT_ELEMENT(expected)
+              .key("acquirePedestal")
+              .displayedName("Acquire Pedestal")
+              .description("Use the next frames received as dark frames, for the pedestal.")
+              .allowedStates(State::PASSIVE, State::ACTIVE)
+              .commit();
+
+        NODE_ELEMENT(expected).key("corrections").displayedName("Corrections").commit();
+
+        VECTOR_DOUBLE_ELEMENT(expected)
+              .key("corrections.relativeGain")
+              .displayedName("Relative Gain")
+              .description(
+                    "The factor to convert the pedestal-subtracted ADC counts to gain 0 ones, indexed by the "
+                    "gain code (0 to 3). Applied from the next acquisition.")
+              .assignmentOptional()
+              .defaultValue(std::vector<double>(NUMBER_OF_GAINS, 1.))
+              .minSize(NUMBER_OF_GAINS)
+              .maxSize(NUMBER_OF_GAINS)
+              .reconfigurable()
+              .commit();
+
+        NODE_ELEMENT(expected)
+              .key("badPixels")
+              .displayedName("Bad Pixels")
+              .description("Bad pixels (or channels) are masked right after unpacking, before any processing.")
+              .commit();
+
+        STRING_ELEMENT(expected)
+              .key("badPixels.file")
+              .displayedName("File")
+              .description(
+                    "File with the indices of the bad pixels in the frame, separated by spaces, commas or new lines. "
+                    "Ranges 'start:end' (end included) are allowed, lines starting with '#' are ignored. The same "
+                    "file as 'badChannels' for the Gotthard2 can be used. Leave empty for no mask.")
+              .assignmentOptional()
+              .defaultValue("")
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        STRING_ELEMENT(expected)
+              .key("badPixels.mode")
+              .displayedName("Mode")
+              .description("'flag': the gain of bad pixels is set to 255; 'zero': adc and gain are set to 0.")
+              .assignmentOptional()
+              .defaultValue("flag")
+              .options(std::vector<std::string>{"flag", "zero"})
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        BOOL_ELEMENT(expected)
+              .key("badPixels.interpolateDisplay")
+              .displayedName("Interpolate Display")
+              .description("Replace the bad pixels with the mean of their good neighbours, in the display channel.")
+              .assignmentOptional()
+              .defaultValue(false)
+              .reconfigurable()
+              .commit();
+
+        UINT32_ELEMENT(expected)
+              .key("badPixels.maskedPixels")
+              .displayedName("Masked Pixels")
+              .description("The number of bad pixels in the current mask.")
+              .readOnly()
+              .initialValue(0)
+              .commit();
+
+        NODE_ELEMENT(expected)
+              .key("commonMode")
+              .displayedName("Common Mode")
+              .description(
+                    "Common-mode correction, applied after pedestal subtraction by the processing stages (e.g. "
+                    "spectrum, clusters). It is estimated per group of pixels, only from the ones in gain 0 and "
+                    "below threshold, and subtracted from the pixels in gain 0.")
+              .commit();
+
+        BOOL_ELEMENT(expected)
+              .key("commonMode.enable")
+              .displayedName("Enable")
+              .assignmentOptional()
+              .defaultValue(false)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        STRING_ELEMENT(expected)
+              .key("commonMode.method")
+              .displayedName("Method")
+              .description("The estimator of the common mode in a group.")
+              .assignmentOptional()
+              .defaultValue("median")
+              .options(std::vector<std::string>{"mean", "median"})
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        FLOAT_ELEMENT(expected)
+              .key("commonMode.threshold")
+              .displayedName("Threshold")
+              .description("Pixels above this threshold (pedestal-subtracted ADC counts) are considered signal.")
+              .assignmentOptional()
+              .defaultValue(30.f)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        NODE_ELEMENT(expected)
+              .key("meanImage")
+              .displayedName("Mean Image")
+              .description(
+                    "Per-pixel mean of the frames in a train, and its exponential moving average across trains, "
+                    "sent to the 'meanImage' output channel.")
+              .commit();
+
+        BOOL_ELEMENT(expected)
+              .key("meanImage.enable")
+              .displayedName("Enable")
+              .assignmentOptional()
+              .defaultValue(false)
+              .reconfigurable()
+              .commit();
+
+        BOOL_ELEMENT(expected)
+              .key("meanImage.std")
+              .displayedName("Standard Deviation")
+              .description("Also send the per-pixel standard deviation of the frames in a train.")
+              .assignmentOptional()
+              .defaultValue(false)
+              .reconfigurable()
+              .commit();
+
+        FLOAT_ELEMENT(expected)
+              .key("meanImage.timeConstant")
+              .displayedName("Time Constant")
+              .description("Time constant of the moving average. If 0, the moving average is the train mean.")
+              .assignmentOptional()
+              .defaultValue(1.f)
+              .minInc(0.f)
+              .unit(Unit::SECOND)
+              .reconfigurable()
+              .commit();
+
+        FLOAT_ELEMENT(expected)
+              .key("meanImage.publishInterval")
+              .displayedName("Publish Interval")
+              .description("Minimum interval between two messages on the 'meanImage' output channel.")
+              .assignmentOptional()
+              .defaultValue(0.5f)
+              .minInc(0.f)
+              .unit(Unit::SECOND)
+              .reconfigurable()
+              .commit();
+
+        Schema meanImageData;
+
+        NODE_ELEMENT(meanImageData).key("data").displayedName("Data").commit();
+
+        NDARRAY_ELEMENT(meanImageData)
+              .key("data.mean")
+              .displayedName("Mean")
+              .description("The mean ADC counts of the frames in the train.")
+              .dtype(karabo::data::Types::FLOAT)
+              .readOnly()
+              .commit();
+
+        NDARRAY_ELEMENT(meanImageData)
+              .key("data.std")
+              .displayedName("Standard Deviation")
+              .description("The standard deviation of the ADC counts of the frames in the train (if enabled).")
+              .dtype(karabo::data::Types::FLOAT)
+              .readOnly()
+              .commit();
+
+        NDARRAY_ELEMENT(meanImageData)
+              .key("data.average")
+              .displayedName("Moving Average")
+              .description("The exponential moving average of the train means.")
+              .dtype(karabo::data::Types::FLOAT)
+              .readOnly()
+              .commit();
+
+        UINT32_ELEMENT(meanImageData).key("data.frames").displayedName("Frames").readOnly().commit();
+
+        OUTPUT_CHANNEL(expected).key("meanImage").displayedName("Mean Image").dataSchema(meanImageData).commit();
+
+        NODE_ELEMENT(expected)
+              .key("daqEncoding")
+              .displayedName("DAQ Encoding")
+              .description(
+                    "Frames sent to the DAQ are encoded one by one: if few pixels have signal, only those are sent "
+                    "(sparse), otherwise all of them (dense). Pixels without signal are lost. The frames are then "
+                    "in 'data.adcValues' and 'data.gainValues', instead of 'data.adc' and 'data.gain'.")
+              .commit();
+
+        BOOL_ELEMENT(expected)
+              .key("daqEncoding.enable")
+              .displayedName("Enable")
+              .assignmentOptional()
+              .defaultValue(false)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        UINT16_ELEMENT(expected)
+              .key("daqEncoding.threshold")
+              .displayedName("Threshold")
+              .description(
+                    "A pixel has signal if its ADC counts are above pedestal (gain 0) plus this threshold, or if it "
+                    "is in a higher gain. Without a valid pedestal, the threshold applies to the raw counts.")
+              .assignmentOptional()
+              .defaultValue(100)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        FLOAT_ELEMENT(expected)
+              .key("daqEncoding.maxOccupancy")
+              .displayedName("Max Occupancy")
+              .description("Maximum fraction of pixels with signal, for a frame to be sent as sparse.")
+              .assignmentOptional()
+              .defaultValue(0.1f)
+              .minInc(0.f)
+              .maxInc(1.f)
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        NODE_ELEMENT(expected)
+              .key("pipeline")
+              .displayedName("Processing Pipeline")
+              .description(
+                    "The frames are first unpacked and masked in the receiver callback, then the complete trains go "
+                    "through the per-train stages, in the given order.")
+              .commit();
+
+        VECTOR_STRING_ELEMENT(expected)
+              .key("pipeline.stages")
+              .displayedName("Stages")
+              .description(
+                    "The enabled processing stages. 'unpack' and 'publish' are mandatory. Base stages: unpack, mask "
+                    "(bad pixels), pedestal (accumulation), meanImage, compress (DAQ encoding), publish (output, "
+                    "daqOutput and display channels). Detector specific stages can be available. The per-frame "
+                    "stages (unpack, mask) must come first and 'publish' last: only the order of the others can be "
+                    "changed.")
+              .assignmentOptional()
+              .defaultValue(std::vector<std::string>{"unpack", "mask", "pedestal", "meanImage", "compress", "publish"})
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        VECTOR_STRING_ELEMENT(expected)
+              .key("pipeline.stageNames")
+              .displayedName("Stage Names")
+              .description("The enabled stages, the timing counters refer to.")
+              .readOnly()
+              .commit();
+
+        VECTOR_DOUBLE_ELEMENT(expected)
+              .key("pipeline.stageTimes")
+              .displayedName("Stage Times")
+              .description(
+                    "Mean execution time of each stage, over the last second: per frame for unpack and mask, per "
+                    "train for the others.")
+              .unit(Unit::SECOND)
+              .metricPrefix(MetricPrefix::MICRO)
+              .readOnly()
+              .commit();
+
+        VECTOR_UINT64_ELEMENT(expected)
+              .key("pipeline.stageCalls")
+              .displayedName("Stage Calls")
+              .description("Number of frames (unpack and mask) or trains processed by each stage, in the last second.")
+              .readOnly()
+              .commit();
+
+        NODE_ELEMENT(expected)
+              .key("affinity")
+              .displayedName("Thread Affinity")
+              .description(
+                    "CPUs the receiver threads are pinned to, as lists like '0-3,8' (empty: not pinned). The "
+                    "train buffers are allocated on the NUMA node of the callback CPUs. Applied at the start of "
+                    "the acquisition. The event-loop threads processing the trains are shared with the other "
+                    "devices in the server, and are thus never pinned.")
+              .commit();
+
+        STRING_ELEMENT(expected)
+              .key("affinity.callbackCpus")
+              .displayedName("Callback CPUs")
+              .description("CPUs for the threads receiving the frames and filling the train buffers.")
+              .assignmentOptional()
+              .defaultValue("")
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        STRING_ELEMENT(expected)
+              .key("affinity.workerCpus")
+              .displayedName("Worker CPUs")
+              .description("CPUs for the worker threads of the detector specific processing (e.g. histograms).")
+              .assignmentOptional()
+              .defaultValue("")
+              .reconfigurable()
+              .allowedStates(State::PASSIVE)
+              .commit();
+
+        STRING_ELEMENT(expected)
+              .key("affinity.placement")
+              .displayedName("Placement")
+              .description("The CPUs and NUMA nodes actually used by the threads and the train buffers.")
+              .readOnly()
+              .commit();
+
         FLOAT_ELEMENT(expected)
               .key("frameRateIn")
               .displayedName("Frame Rate In")
@@ -87,6 +625,13 @@ namespace karabo {
               .readOnly()
               .commit();
 
+        VECTOR_UINT8_ELEMENT(outputData)
+              .key("data.frameValid")
+              .displayedName("Frame Valid")
+              .description("Set to 1 if the frame has been received, 0 otherwise.")
+              .readOnly()
+              .commit();
+
         VECTOR_UINT64_ELEMENT(outputData)
               .key("data.frameNumber")
               .displayedName("Frame Number")
@@ -108,7 +653,31 @@ namespace karabo {
               .readOnly()
               .commit();
 
-        OUTPUT_CHANNEL(expected).key("output").displayedName("PP Output").dataSchema(outputData).commit();
+        // Chunk information, only for the PP output channel
+        Schema ppOutputData = outputData;
+
+        UINT16_ELEMENT(ppOutputData)
+              .key("data.chunkIndex")
+              .displayedName("Chunk Index")
+              .description("The index of the chunk in the train (only if 'chunkSize' is larger than 0).")
+              .readOnly()
+              .commit();
+
+        UINT16_ELEMENT(ppOutputData)
+              .key("data.firstFrame")
+              .displayedName("First Frame")
+              .description("The index in the train of the first frame of the chunk.")
+              .readOnly()
+              .commit();
+
+        BOOL_ELEMENT(ppOutputData)
+              .key("data.lastChunk")
+              .displayedName("Last Chunk")
+              .description("True for the last chunk of the train.")
+              .readOnly()
+              .commit();
+
+        OUTPUT_CHANNEL(expected).key("output").displayedName("PP Output").dataSchema(ppOutputData).commit();
 
         // Second output channel for the DAQ
         OUTPUT_CHANNEL(expected).key("daqOutput").displayedName("DAQ Output").dataSchema(outputData).commit();
@@ -133,24 +702,89 @@ namespace karabo {
     }
 
     void SlsReceiver::preReconfigure(Hash& incomingReconfiguration) {
-        if (incomingReconfiguration.has("framesPerTrain")) {
+        if (incomingReconfiguration.has("framesPerTrain") || incomingReconfiguration.has("daqEncoding.enable")) {
             // Update schema
-            this->updateOutputSchema(incomingReconfiguration.get<unsigned short>("framesPerTrain"));
+            const unsigned short framesPerTrain = incomingReconfiguration.has("framesPerTrain")
+                                                        ? incomingReconfiguration.get<unsigned short>("framesPerTrain")
+                                                        : this->get<unsigned short>("framesPerTrain");
+            const bool daqEncoding = incomingReconfiguration.has("daqEncoding.enable")
+                                           ? incomingReconfiguration.get<bool>("daqEncoding.enable")
+                                           : this->get<bool>("daqEncoding.enable");
+            this->updateOutputSchema(framesPerTrain, daqEncoding);
+        }
+
+        for (const char* key : {"affinity.callbackCpus", "affinity.workerCpus"}) {
+            if (incomingReconfiguration.has(key)) {
+                try {
+                    parseCpuList(incomingReconfiguration.get<std::string>(key));
+                } catch (const std::invalid_argument& e) {
+                    throw KARABO_PARAMETER_EXCEPTION(e.what());
+                }
+            }
+        }
+
+        if (incomingReconfiguration.has("pipeline.stages")) {
+            this->validatePipeline(incomingReconfiguration.get<std::vector<std::string>>("pipeline.stages"));
         }
     }
 
     SlsReceiver::SlsReceiver(const karabo::data::Hash& config)
         : Device(config),
+          m_strand(std::make_shared<karabo::net::Strand>(karabo::net::EventLoop::getIOService())),
           m_receiver(nullptr),
           m_lastFrameNum(0),
           m_lastRateTime(0.),
           m_detectorDataIdx(0),
-          m_strand(std::make_shared<karabo::net::Strand>(karabo::net::EventLoop::getIOService())),
+          m_openTrains(0),
+          m_reorderWindow(1),
+          m_reorderTimeout(0.),
+          m_lateFrames(0),
+          m_misplacedFrames(0),
+          m_trainFlushTimer(karabo::net::EventLoop::getIOService()),
+          m_trainFlushArmed(false),
+          m_chunkSize(0),
+          m_pedestalFramesLeft(0),
+          m_zeroBadPixels(false),
+          m_commonMode(false),
+          m_commonModeMedian(false),
+          m_commonModeThreshold(0.f),
+          m_lastAverageTime(0.),
+          m_lastMeanImageTime(0.),
+          m_daqEncoding(false),
+          m_encodingThreshold(0),
+          m_maxOccupancy(0.f),
+          m_framesEncoded(false),
+          m_unpackStage(nullptr),
+          m_maskStage(nullptr),
+          m_maskEnabled(false),
+          m_lastStageTimesTime(0.),
+          m_acquisitionNumber(0),
           m_frameCount(0),
           m_maxWarnPerAcq(10),
           m_warnCounter(0) {
         KARABO_INITIAL_FUNCTION(initialize);
         KARABO_SLOT(reset);
+        KARABO_SLOT(acquirePedestal);
+
+        // Per-frame stages, run in the receiver callback
+        m_stages.push_back(std::make_unique<ProcessingStage>("unpack"));
+        m_unpackStage = m_stages.back().get();
+        m_stages.push_back(std::make_unique<ProcessingStage>("mask"));
+        m_maskStage = m_stages.back().get();
+
+        // Per-train stages, run in the strand
+        this->registerStage("pedestal", [this](const DetectorData* detectorData, const Timestamp& actualTimestamp) {
+            this->accumulatePedestal(detectorData, actualTimestamp);
+        });
+        this->registerStage("meanImage", [this](const DetectorData* detectorData, const Timestamp& actualTimestamp) {
+            this->processMeanImage(detectorData, actualTimestamp);
+        });
+        this->registerStage("compress", [this](const DetectorData* detectorData, const Timestamp& actualTimestamp) {
+            this->compressTrain(detectorData, actualTimestamp);
+        });
+        this->registerStage("publish", [this](const DetectorData* detectorData, const Timestamp& actualTimestamp) {
+            this->publishTrain(detectorData, actualTimestamp);
+        });
     }
 
     SlsReceiver::~SlsReceiver() {}
@@ -167,6 +801,11 @@ namespace karabo {
         std::stringstream status;
 
         try {
+            this->validatePipeline(this->get<std::vector<std::string>>("pipeline.stages"));
+            for (const char* key : {"affinity.callbackCpus", "affinity.workerCpus"}) {
+                parseCpuList(this->get<std::string>(key));
+            }
+
             std::shared_ptr<sls::Receiver> receiver(new sls::Receiver(rxTcpPort));
 
             // Register callback functions
@@ -175,10 +814,13 @@ namespace karabo {
             receiver->registerCallBackRawDataReady(rawDataReadyCallBack, static_cast<void*>(this));
 
             // Update schema
-            this->updateOutputSchema(this->get<unsigned short>("framesPerTrain"));
+            this->updateOutputSchema(this->get<unsigned short>("framesPerTrain"),
+                                     this->get<bool>("daqEncoding.enable"));
 
             m_receiver.swap(receiver);
 
+            this->initializeDetectorSpecific();
+
             status << "Receiver started on port: " << rxTcpPort;
             this->set("status", status.str());
             KARABO_LOG_INFO << status.str();
@@ -209,15 +851,103 @@ namespace karabo {
             self->m_lastFrameNum = 0;
             self->m_warnCounter = 0;
 
-            // Allocate memory for data
+            self->m_lateFrames = 0;
+            self->m_misplacedFrames = 0;
+            self->set(Hash("frameNumberMapping.drift", 0ll, "frameNumberMapping.maxDrift", 0ll,
+                           "frameNumberMapping.resyncs", 0u));
+
+            // Mapping will be anchored at the first frame
+            FrameNumberMapping& mapping = self->m_frameNumberMapping;
+            mapping.reset();
+            mapping.enable = self->get<bool>("frameNumberMapping.enable");
+            mapping.frameNumbersPerTrain = self->get<unsigned int>("frameNumberMapping.frameNumbersPerTrain");
+            mapping.resyncInterval = self->get<float>("frameNumberMapping.resyncInterval");
+            mapping.driftTolerance = self->get<unsigned int>("frameNumberMapping.driftTolerance");
+
+            // Detector clock will be calibrated at the first frame
+            DetectorClock& clock = self->m_detectorClock;
+            clock.reset();
+            clock.enable = self->get<bool>("detectorClock.enable");
+            clock.calibrationInterval = self->get<float>("detectorClock.calibrationInterval");
+            self->set(Hash("lateFrames", 0ull, "misplacedFrames", 0ull));
+
+            // Wait for the previous acquisition to be written to output channels
+            for (auto& detectorData : self->m_detectorData) {
+                detectorData->mutex.wait();
+                detectorData->mutex.post();
+            }
+
+            // Reload the mask, as the file could have changed
+            self->loadBadPixels();
+            const auto stages = self->get<std::vector<std::string>>("pipeline.stages");
+            self->m_maskEnabled = (std::find(stages.begin(), stages.end(), "mask") != stages.end());
+
+            // One more buffer than the trains in the reorder window, for writing to output channels
+            self->m_reorderWindow = self->get<unsigned short>("reorderWindow");
+            self->m_reorderTimeout = self->get<float>("reorderTimeout");
+            const size_t numberOfBuffers = self->m_reorderWindow + 1;
+            if (self->m_detectorData.size() != numberOfBuffers) {
+                self->m_detectorData.clear();
+                for (size_t i = 0; i < numberOfBuffers; ++i) {
+                    self->m_detectorData.push_back(std::make_unique<DetectorData>());
+                }
+            }
+
+            self->startPlacement();
+
+            // Allocate memory for data, and reset it. Pages are placed on the NUMA node of the thread touching
+            // them first: temporarily run on the callback CPUs, which will fill the buffers
+            const std::vector<int> threadCpus = getThreadAffinity();
+            std::vector<int> callbackCpus;
+            {
+                std::lock_guard<std::mutex> lock(self->m_placementMutex);
+                callbackCpus = self->m_placement[static_cast<size_t>(ThreadRole::callback)].cpus;
+            }
+            const bool firstTouch = !callbackCpus.empty() && setThreadAffinity(callbackCpus);
             const unsigned short framesPerTrain = self->get<unsigned short>("framesPerTrain");
-            self->m_detectorData[0].resize(self->getDetectorSize(), framesPerTrain);
-            self->m_detectorData[1].resize(self->getDetectorSize(), framesPerTrain);
+            self->m_chunkSize = std::min(self->get<unsigned short>("chunkSize"), framesPerTrain);
+            for (auto& detectorData : self->m_detectorData) {
+                detectorData->resize(self->getDetectorSize(), framesPerTrain);
+                detectorData->reset();
+            }
+            if (firstTouch) {
+                setThreadAffinity(threadCpus);
+            }
+
+            // Report where the pages actually are, rather than where they should be
+            std::vector<int> bufferNodes;
+            for (const auto& detectorData : self->m_detectorData) {
+                const std::vector<int> nodes = detectorData->getNodes();
+                bufferNodes.insert(bufferNodes.end(), nodes.begin(), nodes.end());
+            }
+            std::sort(bufferNodes.begin(), bufferNodes.end());
+            bufferNodes.erase(std::unique(bufferNodes.begin(), bufferNodes.end()), bufferNodes.end());
+            const std::vector<int> callbackNodes = getCpuNodes(callbackCpus);
+            if (firstTouch && !bufferNodes.empty() && !callbackNodes.empty() && bufferNodes != callbackNodes) {
+                KARABO_LOG_FRAMEWORK_WARN << "startAcquisitionCallBack: train buffers are on NUMA node(s) "
+                                          << formatCpuList(bufferNodes) << ", callback CPUs on "
+                                          << formatCpuList(callbackNodes);
+            }
+            {
+                std::lock_guard<std::mutex> lock(self->m_placementMutex);
+                self->m_bufferNodes = bufferNodes;
+                self->set("affinity.placement", self->formatPlacement());
+            }
+
+            // The first train is open
+            {
+                std::lock_guard<std::mutex> lock(self->m_trainMutex);
+                self->m_detectorDataIdx = 0;
+                self->m_openTrains = 1;
+                if (self->m_reorderWindow > 1 && !self->m_trainFlushArmed) {
+                    // A previous timer still armed will be kept
+                    self->m_trainFlushArmed = true;
+                    self->scheduleTrainFlush();
+                }
+            }
 
-            // Reset detector data
-            self->m_detectorDataIdx = 0;
-            self->m_detectorData[0].reset();
-            self->m_detectorData[1].reset();
+            self->startAcquisitionDetectorSpecific();
+            self->m_strand->post(karabo::util::bind_weak(&SlsReceiver::startTrainProcessing, self));
 
         } catch (const std::exception& e) {
             KARABO_LOG_FRAMEWORK_WARN << "startAcquisitionCallBack: " << e.what();
@@ -241,11 +971,23 @@ namespace karabo {
             }
 
             // Reset frame rates after acquisition is over
-            const Hash h("frameRateIn", 0., "frameRateOut", 0.);
+            const Hash h("frameRateIn", 0., "frameRateOut", 0., "lateFrames", self->m_lateFrames, "misplacedFrames",
+                         self->m_misplacedFrames);
             self->set(h);
 
+            self->finishAcquisitionDetectorSpecific();
+
+            // Send the trains still open
+            {
+                std::lock_guard<std::mutex> lock(self->m_trainMutex);
+                while (self->m_openTrains > 0) {
+                    self->flushOldestTrain();
+                }
+            }
+
             // Signals end of stream
             // This is done in the same strand as writeToOutputs, to preserve order
+            self->m_strand->post(karabo::util::bind_weak(&SlsReceiver::flushTrainProcessing, self));
             self->m_strand->post(karabo::util::bind_weak(&SlsReceiver::signalEndOfStreams, self));
 
         } catch (const std::exception& e) {
@@ -258,28 +1000,58 @@ namespace karabo {
     }
 
     void SlsReceiver::rawDataReadyCallBack(slsDetectorDefs::sls_receiver_header& header,
-                                           const slsDetectorDefs::dataCallbackHeader, char* dataPointer,
-                                           size_t& dataSize, void* context) {
+                                           const slsDetectorDefs::dataCallbackHeader dataCallbackHeader,
+                                           char* dataPointer, size_t& dataSize, void* context) {
+        Self* self = static_cast<Self*>(context);
+
+        try {
+            self->onRawData(header, dataCallbackHeader, dataPointer, dataSize);
+        } catch (const std::exception& e) {
+            KARABO_LOG_FRAMEWORK_WARN << "rawDataReadyCallBack: " << e.what();
+        } catch (...) {
+            KARABO_LOG_FRAMEWORK_WARN << "rawDataReadyCallBack: other exception";
+        }
+    }
+
+    void SlsReceiver::processRawData(slsDetectorDefs::sls_receiver_header& header,
+                                     const slsDetectorDefs::dataCallbackHeader, char* dataPointer, size_t& dataSize,
+                                     void* context) {
         Self* self = static_cast<Self*>(context);
         const slsDetectorDefs::sls_detector_header& detectorHeader = header.detHeader;
 
         try {
+            self->placeThread(ThreadRole::callback);
+
+            // Only contended by the flush timer
+            std::lock_guard<std::mutex> lock(self->m_trainMutex);
+
             const unsigned short framesPerTrain = self->get<unsigned short>("framesPerTrain");
 
+            // Either from the detector clock, or from the host one
+            const bool useDetectorClock = self->m_detectorClock.enable;
+            const Epochstamp epochstamp =
+                  useDetectorClock ? self->getDetectorClockEpochstamp(detectorHeader) : Epochstamp();
+
             karabo::data::Timestamp actualTimestamp;
             // See https://slsdetectorgroup.github.io/devdoc/udpdetspec.html
             const uint64_t& bunchId = detectorHeader.detSpec1;
             if (bunchId != 0 && bunchId != 0xFFFFFFFFFFFFFFFF) {
                 // The firmware is able to provide bunchId: use it, if available.
-                actualTimestamp = Timestamp(Epochstamp(), bunchId);
+                actualTimestamp = Timestamp(epochstamp, bunchId);
+            } else if (self->m_frameNumberMapping.enable) {
+                actualTimestamp = self->getFrameNumberTimestamp(detectorHeader.frameNumber, epochstamp);
             } else {
                 actualTimestamp = self->getActualTimestamp();
             }
             const double currentTime = actualTimestamp.toTimestamp();
             const unsigned long long trainId = actualTimestamp.getTid();
 
-            // Detector data, trainId, elapsed time
-            DetectorData* detectorData = &(self->m_detectorData[self->m_detectorDataIdx]);
+            // Detector data (latest train), trainId, elapsed time
+            DetectorData* detectorData = self->m_detectorData[self->m_detectorDataIdx].get();
+            if (detectorData->accumulatedFrames == 0) {
+                // First frame of the train
+                detectorData->resetTimestamp(actualTimestamp);
+            }
             const unsigned long long lastTrainId = detectorData->lastTimestamp.getTid();
             const double elapsedTime = currentTime - self->m_lastRateTime;
 
@@ -292,54 +1064,99 @@ namespace karabo {
 
             if ((self->isNewTrain(meta) && detectorData->accumulatedFrames > 0) ||
                 (trainId == 0 && detectorData->accumulatedFrames >= framesPerTrain)) {
-                // A call to 'writeToOutputs' will be posted if:
+                // A new train will be opened if:
                 // 1) 'isNewTrain' returns true AND at least one frame has been accumulated;
                 // OR
                 // 2) 'trainId' is 0 AND 'framesPerTrain' frames are accumulated.
                 // If the SlsReceiver receives trainIds from a TimeServer, condition 1) will be satisfied as soon as a
                 // new train starts, in case there is no connection to TimeServer 2) will be satisfied when
                 // 'detectorData' is full.
+                // The oldest train will be written to the output channels, if the reorder window is full.
+                self->openTrain(actualTimestamp);
+                detectorData = self->m_detectorData[self->m_detectorDataIdx].get();
+
+            } else if (trainId != 0 && trainId < lastTrainId) {
+                // Late frame: route it to its own train, if still open
+                ++self->m_lateFrames;
+                DetectorData* openTrain = self->findOpenTrain(trainId);
+                if (openTrain != nullptr) {
+                    detectorData = openTrain;
+                } else {
+                    ++self->m_misplacedFrames;
+                    if (self->m_reorderWindow > 1) {
+                        self->logWarning("processRawData: frame " + data::toString(detectorHeader.frameNumber) +
+                                         " from train " + data::toString(trainId) + " arrived too late. Skip!");
+                        return;
+                    }
+                }
+            }
 
-                detectorData->mutex.wait(); // "lock", then process detectorData in the event loop
-                self->m_strand->post(karabo::util::bind_weak(&SlsReceiver::writeToOutputs, self,
-                                                             self->m_detectorDataIdx, actualTimestamp));
-
-                // Use next DetectorData object for receiving data
-                self->m_detectorDataIdx = (self->m_detectorDataIdx + 1) % 2;
-                detectorData = &(self->m_detectorData[self->m_detectorDataIdx]);
-                detectorData->resetTimestamp(actualTimestamp);
+            if (self->m_reorderWindow > 1) {
+                self->flushExpiredTrains(currentTime);
             }
 
             const size_t frameSize = sizeof(unsigned short) * self->getDetectorSize();
             if (dataSize == 0) {
-                self->logWarning("rawDataReadyCallBack: received empty buffer. Skip!");
+                self->logWarning("processRawData: received empty buffer. Skip!");
                 return;
             } else if (dataSize % frameSize != 0) {
-                self->logWarning("rawDataReadyCallBack: data size (" + data::toString(dataSize) +
+                self->logWarning("processRawData: data size (" + data::toString(dataSize) +
                                  ") is not multiple of frameSize size (" + data::toString(frameSize) + ")! Skip data.");
                 return;
             }
 
             detectorData->mutex.wait(); // "lock"
-            const unsigned short accumulatedFrames = detectorData->accumulatedFrames;
-            if (accumulatedFrames >= framesPerTrain) {
+            if (detectorData->accumulatedFrames >= framesPerTrain) {
                 // Already got enough frames for this train -> skip data
                 detectorData->mutex.post(); // "unlock"
                 return;
             }
 
             const unsigned int numberOfFrames = dataSize / frameSize;
+            const int frameSlot = self->getFrameSlot(memoryCell);
+            std::chrono::steady_clock::duration unpackTime(0);
+            std::chrono::steady_clock::duration maskTime(0);
+            unsigned int processedFrames = 0;
 
             for (unsigned int i = 0; i < numberOfFrames; ++i) {
-                const size_t offset = self->getDetectorSize() * accumulatedFrames;
+                // Frames are either appended, or stored at the position given by the derived class
+                const size_t slot = (frameSlot < 0) ? detectorData->accumulatedFrames : frameSlot + i;
+                if (slot >= framesPerTrain) {
+                    if (frameSlot >= 0) {
+                        self->logWarning("processRawData: frame slot (" + data::toString(slot) +
+                                         ") is not smaller than framesPerTrain. Skip frame.");
+                    }
+                    break;
+                }
+
+                const size_t offset = self->getDetectorSize() * slot;
                 try {
+                    const auto unpackStart = std::chrono::steady_clock::now();
                     self->unpackRawData(dataPointer, i, detectorData->adc + offset, detectorData->gain + offset);
-                    detectorData->memoryCell[accumulatedFrames] = memoryCell;
-                    detectorData->frameNumber[accumulatedFrames] = detectorHeader.frameNumber;
-                    detectorData->bunchId[accumulatedFrames] = bunchId;
-
-                    detectorData->timestamp[accumulatedFrames] = currentTime;
-                    detectorData->accumulatedFrames += 1;
+                    const auto unpackEnd = std::chrono::steady_clock::now();
+                    unpackTime += unpackEnd - unpackStart;
+                    if (self->m_maskEnabled) {
+                        self->maskBadPixels(detectorData->adc + offset, detectorData->gain + offset);
+                        maskTime += std::chrono::steady_clock::now() - unpackEnd;
+                    }
+                    ++processedFrames;
+                    detectorData->memoryCell[slot] = memoryCell;
+                    detectorData->frameNumber[slot] = detectorHeader.frameNumber;
+                    detectorData->bunchId[slot] = bunchId;
+
+                    if (useDetectorClock) {
+                        // Frames sharing the same header are equally spaced
+                        const DetectorClock& clock = self->m_detectorClock;
+                        const double ticks = detectorHeader.timestamp + i * clock.ticksPerFrame;
+                        detectorData->timestamp[slot] = clock.toTime(ticks);
+                    } else {
+                        detectorData->timestamp[slot] = currentTime;
+                    }
+                    detectorData->lastFrameTime = currentTime;
+                    if (detectorData->frameValid[slot] == 0) {
+                        detectorData->frameValid[slot] = 1;
+                        detectorData->accumulatedFrames += 1;
+                    }
                 } catch (const std::exception& e) {
                     self->logWarning(e.what());
                 }
@@ -347,38 +1164,205 @@ namespace karabo {
 
             detectorData->mutex.post(); // "unlock"
 
+            self->m_unpackStage->addTime(unpackTime, processedFrames);
+            if (self->m_maskEnabled) {
+                self->m_maskStage->addTime(maskTime, processedFrames);
+            }
+
+            if (self->m_chunkSize > 0 && frameSlot < 0) {
+                // Frames are appended: the complete chunks can be sent before the end of the train
+                self->postChunks(detectorData);
+            }
+
             self->m_frameCount += numberOfFrames;
 
-            if (self->m_lastFrameNum == 0) {
-                // First frame received
-                self->m_lastRateTime = currentTime;
-                self->m_lastFrameNum = detectorHeader.frameNumber;
-            } else if (elapsedTime > 1. && detectorHeader.frameNumber > self->m_lastFrameNum) {
-                // Log frame rate once per second
-                const double frameRateIn =
-                      (detectorHeader.frameNumber - self->m_lastFrameNum) / elapsedTime; // Detector rate
-                const double frameRateOut = self->m_frameCount / elapsedTime;            // Receiver rate
+            if (self->m_lastFrameNum == 0) {
+                // First frame received
+                self->m_lastRateTime = currentTime;
+                self->m_lastFrameNum = detectorHeader.frameNumber;
+            } else if (elapsedTime > 1. && detectorHeader.frameNumber > self->m_lastFrameNum) {
+                // Log frame rate once per second
+                const double frameRateIn =
+                      (detectorHeader.frameNumber - self->m_lastFrameNum) / elapsedTime; // Detector rate
+                const double frameRateOut = self->m_frameCount / elapsedTime;            // Receiver rate
+
+                Hash h("frameRateIn", frameRateIn, "frameRateOut", frameRateOut, "lateFrames", self->m_lateFrames,
+                       "misplacedFrames", self->m_misplacedFrames);
+                if (self->m_frameNumberMapping.enable) {
+                    const FrameNumberMapping& mapping = self->m_frameNumberMapping;
+                    h.set("frameNumberMapping.drift", mapping.drift);
+                    h.set("frameNumberMapping.maxDrift", mapping.maxDrift);
+                    h.set("frameNumberMapping.resyncs", mapping.resyncs);
+                }
+                if (useDetectorClock) {
+                    const DetectorClock& clock = self->m_detectorClock;
+                    h.set("detectorClock.offset", clock.offset);
+                    h.set("detectorClock.drift", (clock.baseRate - 1.) * 1.e6);
+                }
+                self->set(h);
+
+                KARABO_LOG_FRAMEWORK_DEBUG << "Current Frame: " << detectorHeader.frameNumber
+                                           << " Last Frame: " << self->m_lastFrameNum
+                                           << " Elapsed time [s]: " << elapsedTime;
+                KARABO_LOG_FRAMEWORK_DEBUG << "Frame rate (detector) " << frameRateIn << " Hz";
+                KARABO_LOG_FRAMEWORK_DEBUG << "Frame rate (receiver) " << frameRateOut << " Hz";
+                KARABO_LOG_FRAMEWORK_DEBUG << "Train ID " << trainId;
+
+                self->m_frameCount = 0;
+                self->m_lastRateTime = currentTime;
+                self->m_lastFrameNum = detectorHeader.frameNumber;
+            }
+
+        } catch (const std::exception& e) {
+            KARABO_LOG_FRAMEWORK_WARN << "processRawData: " << e.what();
+        } catch (...) {
+            KARABO_LOG_FRAMEWORK_WARN << "processRawData: other exception";
+        }
+    }
+
+    karabo::data::Timestamp SlsReceiver::getFrameNumberTimestamp(unsigned long long frameNumber,
+                                                                 const karabo::data::Epochstamp& epochstamp) {
+        FrameNumberMapping& mapping = m_frameNumberMapping;
+        const double currentTime = epochstamp.toTimestamp();
+
+        if (!mapping.anchored) {
+            // First frame of the acquisition: it is expected to be the first frame of its train
+            mapping.anchorFrameNumber = frameNumber;
+            mapping.anchorTrainId = this->getActualTimestamp().getTid();
+            mapping.lastResyncTime = currentTime;
+            mapping.anchored = true;
+
+        } else if (currentTime - mapping.lastResyncTime > mapping.resyncInterval) {
+            // Compare with the time server
+            const long long drift = this->getActualTimestamp().getTid() - mapping.getTrainId(frameNumber);
+            mapping.drift = drift;
+            mapping.maxDrift = std::max(mapping.maxDrift, std::abs(drift));
+            mapping.lastResyncTime = currentTime;
+
+            if (std::abs(drift) > static_cast<long long>(mapping.driftTolerance)) {
+                // Re-anchor, but keep the train boundaries
+                mapping.anchorTrainId += drift;
+                mapping.resyncs += 1;
+                this->logWarning("getFrameNumberTimestamp: trainId re-anchored, drift was " + data::toString(drift));
+            }
+        }
+
+        return Timestamp(epochstamp, mapping.getTrainId(frameNumber));
+    }
+
+    karabo::data::Epochstamp SlsReceiver::getDetectorClockEpochstamp(
+          const slsDetectorDefs::sls_detector_header& detectorHeader) {
+        DetectorClock& clock = m_detectorClock;
+        const uint64_t ticks = detectorHeader.timestamp;
+
+        if (clock.needsCalibration(ticks)) {
+            // The host clock is only read here
+            clock.calibrate(ticks, Epochstamp().toTimestamp());
+        }
+        clock.update(ticks, detectorHeader.frameNumber);
+
+        const double time = clock.toTime(ticks);
+        const unsigned long long seconds = time;
+        const unsigned long long fractions = (time - seconds) * 1.e18; // attoseconds
+        return Epochstamp(seconds, fractions);
+    }
+
+    void SlsReceiver::openTrain(const karabo::data::Timestamp& actualTimestamp) {
+        if (m_openTrains >= m_reorderWindow) {
+            // Window is full
+            this->flushOldestTrain();
+        }
+
+        // Use next DetectorData object for receiving data.
+        // Wait until it has been written to the output channels.
+        m_detectorDataIdx = (m_detectorDataIdx + 1) % m_detectorData.size();
+        DetectorData* detectorData = m_detectorData[m_detectorDataIdx].get();
+        detectorData->mutex.wait();
+        detectorData->resetTimestamp(actualTimestamp);
+        detectorData->mutex.post();
+        ++m_openTrains;
+    }
+
+    void SlsReceiver::flushOldestTrain() {
+        if (m_openTrains == 0) {
+            return;
+        }
+
+        const size_t numberOfBuffers = m_detectorData.size();
+        const unsigned short idx = (m_detectorDataIdx + numberOfBuffers - (m_openTrains - 1)) % numberOfBuffers;
+        DetectorData* detectorData = m_detectorData[idx].get();
+        --m_openTrains;
+
+        if (detectorData->accumulatedFrames > 0) {
+            detectorData->mutex.wait(); // "lock", then process detectorData in the event loop
+            m_strand->post(karabo::util::bind_weak(&SlsReceiver::writeToOutputs, this, idx,
+                                                   detectorData->lastTimestamp));
+        }
+    }
+
+    void SlsReceiver::postChunks(DetectorData* detectorData) {
+        while (detectorData->accumulatedFrames - detectorData->publishedFrames >= m_chunkSize) {
+            const unsigned short firstFrame = detectorData->publishedFrames;
+            detectorData->publishedFrames += m_chunkSize;
+            // The buffer is reset only after the whole train is written, in the same strand
+            m_strand->post(karabo::util::bind_weak(&SlsReceiver::writeChunk, this, detectorData, firstFrame,
+                                                   m_chunkSize, detectorData->lastTimestamp));
+        }
+    }
+
+    void SlsReceiver::flushExpiredTrains(double currentTime) {
+        // Oldest first, the latest train is never flushed
+        while (m_openTrains > 1) {
+            const size_t numberOfBuffers = m_detectorData.size();
+            const unsigned short idx = (m_detectorDataIdx + numberOfBuffers - (m_openTrains - 1)) % numberOfBuffers;
+            if (currentTime - m_detectorData[idx]->lastFrameTime > m_reorderTimeout) {
+                this->flushOldestTrain();
+            } else {
+                break;
+            }
+        }
+    }
 
-                const Hash h("frameRateIn", frameRateIn, "frameRateOut", frameRateOut);
-                self->set(h);
+    void SlsReceiver::scheduleTrainFlush() {
+        // Trains are flushed at most half a timeout late
+        const long delay = std::max(static_cast<long>(m_reorderTimeout * 500.), 10l);
+        m_trainFlushTimer.expires_from_now(boost::posix_time::milliseconds(delay));
+        m_trainFlushTimer.async_wait(
+              karabo::util::bind_weak(&SlsReceiver::onTrainFlushTimer, this, boost::asio::placeholders::error));
+    }
 
-                KARABO_LOG_FRAMEWORK_DEBUG << "Current Frame: " << detectorHeader.frameNumber
-                                           << " Last Frame: " << self->m_lastFrameNum
-                                           << " Elapsed time [s]: " << elapsedTime;
-                KARABO_LOG_FRAMEWORK_DEBUG << "Frame rate (detector) " << frameRateIn << " Hz";
-                KARABO_LOG_FRAMEWORK_DEBUG << "Frame rate (receiver) " << frameRateOut << " Hz";
-                KARABO_LOG_FRAMEWORK_DEBUG << "Train ID " << trainId;
+    void SlsReceiver::onTrainFlushTimer(const boost::system::error_code& ec) {
+        if (ec) {
+            return;
+        }
+        m_strand->post(karabo::util::bind_weak(&SlsReceiver::checkExpiredTrains, this));
+    }
 
-                self->m_frameCount = 0;
-                self->m_lastRateTime = currentTime;
-                self->m_lastFrameNum = detectorHeader.frameNumber;
+    void SlsReceiver::checkExpiredTrains() {
+        // Never wait for the receiver callback: it may be waiting for a buffer released in this strand.
+        // If busy, it is receiving frames, and flushes the expired trains itself.
+        std::unique_lock<std::mutex> lock(m_trainMutex, std::try_to_lock);
+        if (lock.owns_lock()) {
+            if (m_openTrains == 0) {
+                // Acquisition is over
+                m_trainFlushArmed = false;
+                return;
             }
+            this->flushExpiredTrains(Epochstamp().toTimestamp());
+        }
+        this->scheduleTrainFlush();
+    }
 
-        } catch (const std::exception& e) {
-            KARABO_LOG_FRAMEWORK_WARN << "rawDataReadyCallBack: " << e.what();
-        } catch (...) {
-            KARABO_LOG_FRAMEWORK_WARN << "rawDataReadyCallBack: other exception";
+    DetectorData* SlsReceiver::findOpenTrain(unsigned long long trainId) {
+        const size_t numberOfBuffers = m_detectorData.size();
+        for (unsigned short i = 0; i < m_openTrains; ++i) {
+            const unsigned short idx = (m_detectorDataIdx + numberOfBuffers - i) % numberOfBuffers;
+            DetectorData* detectorData = m_detectorData[idx].get();
+            if (detectorData->lastTimestamp.getTid() == trainId) {
+                return detectorData;
+            }
         }
+        return nullptr;
     }
 
     bool SlsReceiver::isNewTrain(const karabo::data::Hash& meta) {
@@ -402,14 +1386,18 @@ namespace karabo {
         }
     }
 
-    void SlsReceiver::updateOutputSchema(unsigned short framesPerTrain) {
+    void SlsReceiver::updateOutputSchema(unsigned short framesPerTrain, bool daqEncoding) {
         Schema dataSchema;
+        Schema encodedDataSchema; // DAQ only
         const std::vector<unsigned long long> shape = this->getDaqShape(framesPerTrain);
+        const unsigned long long maxValues = framesPerTrain * this->getDetectorSize();
 
         KARABO_LOG_FRAMEWORK_DEBUG << "Updating output schema";
 
         NODE_ELEMENT(dataSchema).key("data").displayedName("Data").setDaqDataType(DaqDataType::TRAIN).commit();
 
+        NODE_ELEMENT(encodedDataSchema).key("data").displayedName("Data").setDaqDataType(DaqDataType::TRAIN).commit();
+
         NDARRAY_ELEMENT(dataSchema)
               .key("data.adc")
               .displayedName("ADC")
@@ -428,44 +1416,122 @@ namespace karabo {
               .readOnly()
               .commit();
 
-        VECTOR_UINT8_ELEMENT(dataSchema)
-              .key("data.memoryCell")
-              .displayedName("Memory Cell")
-              .description("The number of the memory cell used to store the image (only for Jungfrau).")
+        VECTOR_UINT8_ELEMENT(encodedDataSchema)
+              .key("data.encoding")
+              .displayedName("Encoding")
+              .description("The frame encoding: 0 for dense, 1 for sparse.")
               .maxSize(framesPerTrain)
               .readOnly()
               .commit();
 
-        VECTOR_UINT64_ELEMENT(dataSchema)
-              .key("data.frameNumber")
-              .displayedName("Frame Number")
-              .description("The frame number.")
+        VECTOR_UINT32_ELEMENT(encodedDataSchema)
+              .key("data.pixelCount")
+              .displayedName("Pixel Count")
+              .description("The number of values stored for each frame.")
               .maxSize(framesPerTrain)
               .readOnly()
               .commit();
 
-        VECTOR_UINT64_ELEMENT(dataSchema)
-              .key("data.bunchId")
-              .displayedName("Bunch ID")
-              .description("The bunch ID from the beamline, if available.")
-              .maxSize(framesPerTrain)
+        VECTOR_UINT32_ELEMENT(encodedDataSchema)
+              .key("data.index")
+              .displayedName("Index")
+              .description("The pixel indices of the values of sparse frames.")
+              .maxSize(maxValues)
               .readOnly()
               .commit();
 
-        VECTOR_DOUBLE_ELEMENT(dataSchema)
-              .key("data.timestamp")
-              .displayedName("Timestamp")
-              .description("The data timestamp.")
-              .maxSize(framesPerTrain)
+        VECTOR_UINT16_ELEMENT(encodedDataSchema)
+              .key("data.adcValues")
+              .displayedName("ADC Values")
+              .description("The ADC counts of all frames, concatenated.")
+              .maxSize(maxValues)
+              .readOnly()
+              .commit();
+
+        VECTOR_UINT8_ELEMENT(encodedDataSchema)
+              .key("data.gainValues")
+              .displayedName("Gain Values")
+              .description("The ADC gains of all frames, concatenated.")
+              .maxSize(maxValues)
+              .readOnly()
+              .commit();
+
+        for (Schema* schema : {&dataSchema, &encodedDataSchema}) {
+            VECTOR_UINT8_ELEMENT(*schema)
+                  .key("data.memoryCell")
+                  .displayedName("Memory Cell")
+                  .description("The number of the memory cell used to store the image (only for Jungfrau).")
+                  .maxSize(framesPerTrain)
+                  .readOnly()
+                  .commit();
+
+            VECTOR_UINT8_ELEMENT(*schema)
+                  .key("data.frameValid")
+                  .displayedName("Frame Valid")
+                  .description("Set to 1 if the frame has been received, 0 otherwise.")
+                  .maxSize(framesPerTrain)
+                  .readOnly()
+                  .commit();
+
+            VECTOR_UINT64_ELEMENT(*schema)
+                  .key("data.frameNumber")
+                  .displayedName("Frame Number")
+                  .description("The frame number.")
+                  .maxSize(framesPerTrain)
+                  .readOnly()
+                  .commit();
+
+            VECTOR_UINT64_ELEMENT(*schema)
+                  .key("data.bunchId")
+                  .displayedName("Bunch ID")
+                  .description("The bunch ID from the beamline, if available.")
+                  .maxSize(framesPerTrain)
+                  .readOnly()
+                  .commit();
+
+            VECTOR_DOUBLE_ELEMENT(*schema)
+                  .key("data.timestamp")
+                  .displayedName("Timestamp")
+                  .description("The data timestamp.")
+                  .maxSize(framesPerTrain)
+                  .readOnly()
+                  .commit();
+        }
+
+        // Chunk information, only for the PP output channel
+        Schema ppDataSchema = dataSchema;
+
+        UINT16_ELEMENT(ppDataSchema)
+              .key("data.chunkIndex")
+              .displayedName("Chunk Index")
+              .description("The index of the chunk in the train (only if 'chunkSize' is larger than 0).")
+              .readOnly()
+              .commit();
+
+        UINT16_ELEMENT(ppDataSchema)
+              .key("data.firstFrame")
+              .displayedName("First Frame")
+              .description("The index in the train of the first frame of the chunk.")
+              .readOnly()
+              .commit();
+
+        BOOL_ELEMENT(ppDataSchema)
+              .key("data.lastChunk")
+              .displayedName("Last Chunk")
+              .description("True for the last chunk of the train.")
               .readOnly()
               .commit();
 
         // New schema for output channel
         Schema schema;
 
-        OUTPUT_CHANNEL(schema).key("output").displayedName("PP Output").dataSchema(dataSchema).commit();
+        OUTPUT_CHANNEL(schema).key("output").displayedName("PP Output").dataSchema(ppDataSchema).commit();
 
-        OUTPUT_CHANNEL(schema).key("daqOutput").displayedName("DAQ Output").dataSchema(dataSchema).commit();
+        OUTPUT_CHANNEL(schema)
+              .key("daqOutput")
+              .displayedName("DAQ Output")
+              .dataSchema(daqEncoding ? encodedDataSchema : dataSchema)
+              .commit();
 
         // Update the device schema
         this->appendSchema(schema);
@@ -475,37 +1541,367 @@ namespace karabo {
         this->signalEndOfStream("output");
         this->signalEndOfStream("daqOutput");
         this->signalEndOfStream("display");
+        this->signalEndOfStream("meanImage");
+        this->signalEndOfStreamsDetectorSpecific();
+    }
+
+    void SlsReceiver::registerStage(const std::string& name, const ProcessingStage::Function& process) {
+        if (this->findStage(name) != nullptr) {
+            throw KARABO_LOGIC_EXCEPTION("Processing stage already registered: " + name);
+        }
+        m_stages.push_back(std::make_unique<ProcessingStage>(name, process));
+    }
+
+    void SlsReceiver::acquirePedestal() {
+        // Pedestal is accumulated in the strand
+        const unsigned int frames = this->get<unsigned int>("pedestal.frames");
+        m_strand->post(karabo::util::bind_weak(&SlsReceiver::startPedestal, this, frames));
+    }
+
+    void SlsReceiver::startPedestal(unsigned int frames) {
+        m_pedestal.resize(this->getDetectorSize());
+        m_pedestalFramesLeft = frames;
+        this->set(Hash("pedestal.acquiredFrames", 0u, "pedestal.valid", false));
+        KARABO_LOG_FRAMEWORK_INFO << "Acquiring pedestal from the next " << frames << " frames";
+    }
+
+    void SlsReceiver::startTrainProcessing() {
+        m_relativeGain = this->get<std::vector<double>>("corrections.relativeGain");
+        m_commonMode = this->get<bool>("commonMode.enable");
+        m_commonModeMedian = (this->get<std::string>("commonMode.method") == "median");
+        m_commonModeThreshold = this->get<float>("commonMode.threshold");
+        if (m_commonMode) {
+            // Group of each pixel
+            const size_t detectorSize = this->getDetectorSize();
+            m_commonModeGroup.resize(detectorSize);
+            unsigned int groups = 0;
+            for (size_t i = 0; i < detectorSize; ++i) {
+                m_commonModeGroup[i] = this->getCommonModeGroup(i);
+                groups = std::max(groups, m_commonModeGroup[i] + 1);
+            }
+            m_commonModeEstimate.resize(groups);
+            m_commonModeSum.resize(groups);
+            m_commonModeCount.resize(groups);
+            m_commonModeValues.resize(groups);
+        }
+        m_imageAverage.clear(); // Moving average restarts at every acquisition
+        m_daqEncoding = this->get<bool>("daqEncoding.enable");
+        m_encodingThreshold = this->get<unsigned short>("daqEncoding.threshold");
+        m_maxOccupancy = this->get<float>("daqEncoding.maxOccupancy");
+
+        // Stages enabled for this acquisition
+        m_pipeline.clear();
+        m_timedStages.clear();
+        for (const std::string& name : this->get<std::vector<std::string>>("pipeline.stages")) {
+            ProcessingStage* stage = this->findStage(name);
+            if (stage == nullptr) {
+                continue; // Already validated
+            }
+            if (!stage->isFrameStage()) {
+                m_pipeline.push_back(stage);
+            }
+            m_timedStages.push_back(stage);
+        }
+        for (const auto& stage : m_stages) {
+            stage->calls = 0;
+            stage->nanoseconds = 0;
+        }
+        m_lastStageTimesTime = this->getActualTimestamp().toTimestamp();
+
+        this->resetTrainProcessing();
     }
 
-    void SlsReceiver::writeToOutputs(unsigned char idx, const karabo::data::Timestamp& actualTimestamp) {
-        DetectorData* detectorData = &m_detectorData[idx];
+    void SlsReceiver::accumulatePedestal(const DetectorData* detectorData,
+                                         const karabo::data::Timestamp& actualTimestamp) {
+        if (m_pedestalFramesLeft == 0) {
+            return;
+        }
 
         const size_t detectorSize = this->getDetectorSize();
-        const auto framesPerTrain = this->get<unsigned short>("framesPerTrain");
-        const size_t size = detectorSize * framesPerTrain;
+        const unsigned char* zeroed = this->getZeroedPixels();
+        for (size_t frame = 0; frame < detectorData->frameValid.size() && m_pedestalFramesLeft > 0; ++frame) {
+            if (detectorData->frameValid[frame] != 0) {
+                const size_t offset = frame * detectorSize;
+                m_pedestal.add(detectorData->adc + offset, detectorData->gain + offset, zeroed);
+                --m_pedestalFramesLeft;
+            }
+        }
 
-        // The Pipeline shape is an array of display shapes
-        std::vector<unsigned long long> vPPShape = this->getDisplayShape();
-        vPPShape.insert(vPPShape.begin(), framesPerTrain);
-        const Dims ppShape = vPPShape;
-        NDArray adcTrainData(detectorData->adc, size, NDArray::NullDeleter(), ppShape);   // No-copy constructor
-        NDArray gainTrainData(detectorData->gain, size, NDArray::NullDeleter(), ppShape); // No-copy constructor
+        const unsigned int frames = this->get<unsigned int>("pedestal.frames");
+        if (m_pedestalFramesLeft == 0) {
+            m_pedestal.finalize();
+            this->set(Hash("pedestal.acquiredFrames", frames, "pedestal.valid", true));
+            KARABO_LOG_FRAMEWORK_INFO << "Pedestal acquired";
+        } else {
+            this->set("pedestal.acquiredFrames", frames - m_pedestalFramesLeft);
+        }
+    }
+
+    void SlsReceiver::processMeanImage(const DetectorData* detectorData,
+                                       const karabo::data::Timestamp& actualTimestamp) {
+        if (!this->get<bool>("meanImage.enable")) {
+            return;
+        }
+
+        const size_t detectorSize = this->getDetectorSize();
+        const bool computeStd = this->get<bool>("meanImage.std");
+        const unsigned char* zeroed = this->getZeroedPixels();
+        m_imageSum.assign(detectorSize, 0);
+        m_imageCount.assign(detectorSize, 0);
+        if (computeStd) {
+            m_imageSum2.assign(detectorSize, 0);
+        }
+
+        // Frame by frame, to keep the inner loops contiguous (and vectorizable)
+        unsigned int frames = 0;
+        for (size_t frame = 0; frame < detectorData->frameValid.size(); ++frame) {
+            if (detectorData->frameValid[frame] == 0) {
+                continue;
+            }
+            const unsigned short* adc = detectorData->adc + frame * detectorSize;
+            const unsigned char* gain = detectorData->gain + frame * detectorSize;
+            unsigned long long* sum = m_imageSum.data();
+            unsigned int* count = m_imageCount.data();
+            for (size_t i = 0; i < detectorSize; ++i) {
+                const unsigned int good = (gain[i] != BAD_PIXEL_GAIN) && (zeroed == nullptr || zeroed[i] == 0);
+                sum[i] += good * adc[i];
+                count[i] += good;
+            }
+            if (computeStd) {
+                unsigned long long* sum2 = m_imageSum2.data();
+                for (size_t i = 0; i < detectorSize; ++i) {
+                    const bool good = (gain[i] != BAD_PIXEL_GAIN) && (zeroed == nullptr || zeroed[i] == 0);
+                    const unsigned long long value = good ? adc[i] : 0;
+                    sum2[i] += value * value;
+                }
+            }
+            ++frames;
+        }
+        if (frames == 0) {
+            return;
+        }
+
+        m_imageMean.resize(detectorSize);
+        if (computeStd) {
+            m_imageStd.resize(detectorSize);
+        }
+        for (size_t i = 0; i < detectorSize; ++i) {
+            const unsigned int count = m_imageCount[i];
+            if (count == 0) {
+                // Bad pixel in all the frames
+                m_imageMean[i] = 0.f;
+                if (computeStd) {
+                    m_imageStd[i] = 0.f;
+                }
+                continue;
+            }
+            const double mean = static_cast<double>(m_imageSum[i]) / count;
+            m_imageMean[i] = mean;
+            if (computeStd) {
+                const double variance = static_cast<double>(m_imageSum2[i]) / count - mean * mean;
+                m_imageStd[i] = std::sqrt(std::max(variance, 0.));
+            }
+        }
+
+        // Exponential moving average, weighted by the time elapsed since the previous train
+        const float timeConstant = this->get<float>("meanImage.timeConstant");
+        const double currentTime = actualTimestamp.toTimestamp();
+        if (m_imageAverage.size() != detectorSize || timeConstant <= 0.f) {
+            m_imageAverage = m_imageMean;
+        } else {
+            const float alpha = 1. - std::exp(-std::max(currentTime - m_lastAverageTime, 0.) / timeConstant);
+            for (size_t i = 0; i < detectorSize; ++i) {
+                m_imageAverage[i] += alpha * (m_imageMean[i] - m_imageAverage[i]);
+            }
+        }
+        m_lastAverageTime = currentTime;
+
+        if (currentTime - m_lastMeanImageTime < this->get<float>("meanImage.publishInterval")) {
+            return;
+        }
+        m_lastMeanImageTime = currentTime;
+
+        const Dims shape = this->getDisplayShape();
+        Hash meanImage;
+        meanImage.set("data.mean", NDArray(m_imageMean.data(), detectorSize, NDArray::NullDeleter(), shape));
+        if (computeStd) {
+            meanImage.set("data.std", NDArray(m_imageStd.data(), detectorSize, NDArray::NullDeleter(), shape));
+        }
+        meanImage.set("data.average", NDArray(m_imageAverage.data(), detectorSize, NDArray::NullDeleter(), shape));
+        meanImage.set("data.frames", frames);
+        this->writeChannel("meanImage", meanImage, actualTimestamp);
+    }
+
+    void SlsReceiver::correctFrame(const DetectorData* detectorData, size_t frame, float* corrected) {
+        const size_t detectorSize = detectorData->size / detectorData->frameValid.size();
+        const unsigned short* adc = detectorData->adc + frame * detectorSize;
+        const unsigned char* gain = detectorData->gain + frame * detectorSize;
+        const bool subtractPedestal = m_pedestal.isValid() && m_pedestal.pixels() == detectorSize;
+        const unsigned char* zeroed = this->getZeroedPixels();
+
+        for (size_t i = 0; i < detectorSize; ++i) {
+            const unsigned char g = gain[i] & (NUMBER_OF_GAINS - 1);
+            const float pedestal = subtractPedestal ? m_pedestal.mean(g, i) : 0.f;
+            corrected[i] = (gain[i] != BAD_PIXEL_GAIN) ? adc[i] - pedestal : 0.f;
+        }
+        if (zeroed != nullptr) {
+            for (const unsigned int i : m_badPixels) {
+                corrected[i] = 0.f;
+            }
+        }
+
+        if (m_commonMode && subtractPedestal) {
+            // Before gain weighting, as the threshold is in gain 0 counts
+            this->applyCommonMode(gain, zeroed, corrected);
+        }
+
+        for (size_t i = 0; i < detectorSize; ++i) {
+            corrected[i] *= m_relativeGain[gain[i] & (NUMBER_OF_GAINS - 1)];
+        }
+    }
+
+    void SlsReceiver::applyCommonMode(const unsigned char* gain, const unsigned char* excluded, float* corrected) {
+        const size_t detectorSize = m_commonModeGroup.size();
+        const size_t groups = m_commonModeEstimate.size();
+        const unsigned int* group = m_commonModeGroup.data();
+        const auto inGain0 = [gain, excluded](size_t i) {
+            return gain[i] == 0 && (excluded == nullptr || excluded[i] == 0);
+        };
+
+        // Only pixels in gain 0 and without signal contribute (not the zeroed bad pixels)
+        if (m_commonModeMedian) {
+            for (auto& values : m_commonModeValues) {
+                values.clear();
+            }
+            for (size_t i = 0; i < detectorSize; ++i) {
+                if (inGain0(i) && corrected[i] < m_commonModeThreshold) {
+                    m_commonModeValues[group[i]].push_back(corrected[i]);
+                }
+            }
+            for (size_t g = 0; g < groups; ++g) {
+                std::vector<float>& values = m_commonModeValues[g];
+                if (values.empty()) {
+                    m_commonModeEstimate[g] = 0.f;
+                } else {
+                    auto median = values.begin() + values.size() / 2;
+                    std::nth_element(values.begin(), median, values.end());
+                    m_commonModeEstimate[g] = *median;
+                }
+            }
+        } else {
+            std::fill(m_commonModeSum.begin(), m_commonModeSum.end(), 0.);
+            std::fill(m_commonModeCount.begin(), m_commonModeCount.end(), 0);
+            for (size_t i = 0; i < detectorSize; ++i) {
+                if (inGain0(i) && corrected[i] < m_commonModeThreshold) {
+                    m_commonModeSum[group[i]] += corrected[i];
+                    m_commonModeCount[group[i]] += 1;
+                }
+            }
+            for (size_t g = 0; g < groups; ++g) {
+                const unsigned int count = m_commonModeCount[g];
+                m_commonModeEstimate[g] = (count > 0) ? m_commonModeSum[g] / count : 0.f;
+            }
+        }
+
+        for (size_t i = 0; i < detectorSize; ++i) {
+            if (inGain0(i)) {
+                corrected[i] -= m_commonModeEstimate[group[i]];
+            }
+        }
+    }
+
+    void SlsReceiver::writeToOutputs(unsigned short idx, const karabo::data::Timestamp& actualTimestamp) {
+        DetectorData* detectorData = m_detectorData[idx].get();
+
+        m_framesEncoded = false;
+        for (ProcessingStage* stage : m_pipeline) {
+            try {
+                stage->run(detectorData, actualTimestamp);
+            } catch (const std::exception& e) {
+                KARABO_LOG_FRAMEWORK_WARN << "writeToOutputs: stage " << stage->name << ": " << e.what();
+            }
+        }
+
+        const double currentTime = actualTimestamp.toTimestamp();
+        if (currentTime - m_lastStageTimesTime > 1.) {
+            this->publishStageTimes();
+            m_lastStageTimesTime = currentTime;
+        }
+
+        detectorData->reset();      // reset detector data
+        detectorData->mutex.post(); // "unlock"
+    }
+
+    void SlsReceiver::compressTrain(const DetectorData* detectorData, const karabo::data::Timestamp& actualTimestamp) {
+        if (m_daqEncoding) {
+            this->encodeFrames(detectorData);
+            m_framesEncoded = true;
+        }
+    }
+
+    void SlsReceiver::publishTrain(const DetectorData* detectorData, const karabo::data::Timestamp& actualTimestamp) {
+        const size_t detectorSize = this->getDetectorSize();
+        const auto framesPerTrain = this->get<unsigned short>("framesPerTrain");
 
         // KARABO_LOG_FRAMEWORK_DEBUG << "Ready to output data. trainId=" << trainId <<
         //         " lastTrainId=" << lastTrainId << " accumulatedFrames=" << detectorData.accumulatedFrames;
 
-        // Send unpacked data to output channel - for PP
+        // Unpacked data of the whole train, for the PP unless sent in chunks, and for the DAQ unless encoded
         Hash output;
-        output.set("data.adc", adcTrainData);
-        output.set("data.gain", gainTrainData);
-        output.set("data.memoryCell", detectorData->memoryCell);
-        output.set("data.frameNumber", detectorData->frameNumber);
-        output.set("data.bunchId", detectorData->bunchId);
-        output.set("data.timestamp", detectorData->timestamp);
-        this->writeChannel("output", output, detectorData->lastTimestamp);
+        if (m_chunkSize == 0 || !m_daqEncoding) {
+            const size_t size = detectorSize * framesPerTrain;
+
+            // The Pipeline shape is an array of display shapes
+            std::vector<unsigned long long> vPPShape = this->getDisplayShape();
+            vPPShape.insert(vPPShape.begin(), framesPerTrain);
+            const Dims ppShape = vPPShape;
+            NDArray adcTrainData(detectorData->adc, size, NDArray::NullDeleter(), ppShape);   // No-copy constructor
+            NDArray gainTrainData(detectorData->gain, size, NDArray::NullDeleter(), ppShape); // No-copy constructor
+
+            output.set("data.adc", adcTrainData);
+            output.set("data.gain", gainTrainData);
+            output.set("data.memoryCell", detectorData->memoryCell);
+            output.set("data.frameValid", detectorData->frameValid);
+            output.set("data.frameNumber", detectorData->frameNumber);
+            output.set("data.bunchId", detectorData->bunchId);
+            output.set("data.timestamp", detectorData->timestamp);
+        }
+
+        // Send unpacked data to output channel - for PP
+        if (m_chunkSize > 0) {
+            // Remaining chunks, the last one can be shorter
+            for (unsigned short firstFrame = detectorData->publishedFrames; firstFrame < framesPerTrain;
+                 firstFrame += m_chunkSize) {
+                const unsigned short numberOfFrames =
+                      std::min<unsigned short>(m_chunkSize, framesPerTrain - firstFrame);
+                this->writeChunk(detectorData, firstFrame, numberOfFrames, detectorData->lastTimestamp);
+            }
+        } else {
+            this->writeChannel("output", output, detectorData->lastTimestamp);
+        }
 
         // Then send data to the DAQ
-        this->writeChannel("daqOutput", output, detectorData->lastTimestamp);
+        if (m_daqEncoding) {
+            if (!m_framesEncoded) {
+                // "compress" stage not enabled, but the DAQ schema expects encoded frames
+                this->encodeFrames(detectorData);
+            }
+
+            Hash daqOutput;
+            daqOutput.set("data.encoding", m_encodedFrames.encoding);
+            daqOutput.set("data.pixelCount", m_encodedFrames.pixelCount);
+            daqOutput.set("data.index", m_encodedFrames.index);
+            daqOutput.set("data.adcValues", m_encodedFrames.adc);
+            daqOutput.set("data.gainValues", m_encodedFrames.gain);
+            daqOutput.set("data.memoryCell", detectorData->memoryCell);
+            daqOutput.set("data.frameValid", detectorData->frameValid);
+            daqOutput.set("data.frameNumber", detectorData->frameNumber);
+            daqOutput.set("data.bunchId", detectorData->bunchId);
+            daqOutput.set("data.timestamp", detectorData->timestamp);
+            this->writeChannel("daqOutput", daqOutput, detectorData->lastTimestamp);
+        } else {
+            this->writeChannel("daqOutput", output, detectorData->lastTimestamp);
+        }
 
         if (this->get<bool>("onlineDisplayEnable")) {
             // Send unpacked data to output channel - for GUI
@@ -513,6 +1909,9 @@ namespace karabo {
             if (frameToDisplay < framesPerTrain) {
                 const unsigned short* adcOffset = detectorData->adc + frameToDisplay * detectorSize;
                 const unsigned char* gainOffset = detectorData->gain + frameToDisplay * detectorSize;
+                if (!m_badPixels.empty() && this->get<bool>("badPixels.interpolateDisplay")) {
+                    adcOffset = this->interpolateBadPixels(adcOffset);
+                }
                 std::vector<unsigned long long> displayShape = this->getDisplayShape();
                 Hash display;
 
@@ -541,8 +1940,289 @@ namespace karabo {
                 this->writeChannel("display", display, detectorData->lastTimestamp);
             }
         }
+    }
 
-        detectorData->reset();      // reset detector data
-        detectorData->mutex.post(); // "unlock"
+    void SlsReceiver::startPlacement() {
+        std::lock_guard<std::mutex> lock(m_placementMutex);
+        m_placement[static_cast<size_t>(ThreadRole::callback)].reset(
+              parseCpuList(this->get<std::string>("affinity.callbackCpus")));
+        m_placement[static_cast<size_t>(ThreadRole::worker)].reset(
+              parseCpuList(this->get<std::string>("affinity.workerCpus")));
+        ++m_acquisitionNumber;
+    }
+
+    void SlsReceiver::placeThread(ThreadRole role) {
+        // Each thread is placed once per device and acquisition
+        thread_local const SlsReceiver* placedBy = nullptr;
+        thread_local unsigned int placedAcquisition = 0;
+        const unsigned int acquisition = m_acquisitionNumber;
+        if (placedBy == this && placedAcquisition == acquisition) {
+            return;
+        }
+        placedBy = this;
+        placedAcquisition = acquisition;
+
+        // The affinity the thread had before being pinned, restored when the CPU list is cleared
+        thread_local std::vector<int> originalCpus;
+        thread_local bool pinned = false;
+
+        std::lock_guard<std::mutex> lock(m_placementMutex);
+        ThreadPlacement& placement = m_placement[static_cast<size_t>(role)];
+        if (placement.cpus.empty()) {
+            if (pinned && setThreadAffinity(originalCpus)) {
+                pinned = false;
+            }
+            return;
+        }
+        if (!pinned) {
+            originalCpus = getThreadAffinity();
+        }
+
+        if (setThreadAffinity(placement.cpus)) {
+            pinned = true;
+            placement.pinned += 1;
+        } else {
+            placement.failed += 1;
+            KARABO_LOG_FRAMEWORK_WARN << "placeThread: cannot pin thread to CPUs " << formatCpuList(placement.cpus);
+        }
+        // Threads are long-lived, and placed once per acquisition
+        this->set("affinity.placement", this->formatPlacement());
+    }
+
+    std::string SlsReceiver::formatPlacement() const {
+        // To be called with m_placementMutex locked
+        const auto nodes = [](const std::vector<int>& nodes) {
+            return nodes.empty() ? std::string("unknown") : formatCpuList(nodes);
+        };
+
+        std::ostringstream report;
+        const char* roles[] = {"callback", "worker"};
+        for (size_t i = 0; i < 2; ++i) {
+            const ThreadPlacement& placement = m_placement[i];
+            report << roles[i] << ": ";
+            if (placement.cpus.empty()) {
+                report << "not pinned";
+            } else {
+                report << "CPUs " << formatCpuList(placement.cpus) << " (NUMA node " << nodes(placement.nodes)
+                       << ")";
+                if (placement.failed > 0) {
+                    report << ", " << placement.failed << " thread(s) could not be pinned";
+                }
+            }
+            report << "; ";
+        }
+        report << "buffers: ";
+        if (m_bufferNodes.empty()) {
+            report << "NUMA node unknown";
+        } else {
+            report << "NUMA node " << nodes(m_bufferNodes);
+        }
+        return report.str();
+    }
+
+    ProcessingStage* SlsReceiver::findStage(const std::string& name) const {
+        for (const auto& stage : m_stages) {
+            if (stage->name == name) {
+                return stage.get();
+            }
+        }
+        return nullptr;
+    }
+
+    void SlsReceiver::validatePipeline(const std::vector<std::string>& stages) const {
+        for (size_t i = 0; i < stages.size(); ++i) {
+            if (this->findStage(stages[i]) == nullptr) {
+                throw KARABO_PARAMETER_EXCEPTION("Unknown processing stage: " + stages[i]);
+            } else if (std::find(stages.begin(), stages.begin() + i, stages[i]) != stages.begin() + i) {
+                throw KARABO_PARAMETER_EXCEPTION("Processing stage listed twice: " + stages[i]);
+            }
+        }
+        for (const char* name : {"unpack", "publish"}) {
+            if (std::find(stages.begin(), stages.end(), name) == stages.end()) {
+                throw KARABO_PARAMETER_EXCEPTION(std::string("Processing stage cannot be disabled: ") + name);
+            }
+        }
+
+        // The frame stages always run in the receiver callback, before the train ones: their order is not free
+        bool trainStageListed = false;
+        for (const std::string& name : stages) {
+            if (this->findStage(name)->process) {
+                trainStageListed = true;
+            } else if (trainStageListed) {
+                throw KARABO_PARAMETER_EXCEPTION("Per-frame processing stage '" + name +
+                                                 "' must be listed before the per-train ones");
+            }
+        }
+        // Otherwise, the train would be encoded by 'publish', and then again by 'compress'
+        if (stages.back() != "publish") {
+            throw KARABO_PARAMETER_EXCEPTION("'publish' must be the last processing stage");
+        }
+    }
+
+    void SlsReceiver::publishStageTimes() {
+        std::vector<std::string> names;
+        std::vector<double> times;
+        std::vector<unsigned long long> calls;
+        for (ProcessingStage* stage : m_timedStages) {
+            const unsigned long long stageCalls = stage->calls.exchange(0);
+            const unsigned long long nanoseconds = stage->nanoseconds.exchange(0);
+            names.push_back(stage->name);
+            times.push_back(stageCalls > 0 ? 1.e-3 * nanoseconds / stageCalls : 0.);
+            calls.push_back(stageCalls);
+        }
+        this->set(Hash("pipeline.stageNames", names, "pipeline.stageTimes", times, "pipeline.stageCalls", calls));
+    }
+
+    void SlsReceiver::loadBadPixels() {
+        const std::string filename = this->get<std::string>("badPixels.file");
+        const size_t detectorSize = this->getDetectorSize();
+        m_zeroBadPixels = (this->get<std::string>("badPixels.mode") == "zero");
+        m_badPixels.clear();
+        m_isBadPixel.assign(detectorSize, false);
+
+        if (!filename.empty()) {
+            try {
+                std::ifstream file(filename);
+                if (!file.is_open()) {
+                    throw KARABO_IO_EXCEPTION("Cannot open " + filename);
+                }
+
+                std::string line;
+                while (std::getline(file, line)) {
+                    if (line.empty() || line[0] == '#') {
+                        continue;
+                    }
+                    std::replace(line.begin(), line.end(), ',', ' ');
+                    std::istringstream tokens(line);
+                    std::string token;
+                    while (tokens >> token) {
+                        // Single index, or range "start:end"
+                        const size_t colon = token.find(':');
+                        const unsigned long start = std::stoul(token.substr(0, colon));
+                        const unsigned long end =
+                              (colon == std::string::npos) ? start : std::stoul(token.substr(colon + 1));
+                        for (unsigned long i = start; i <= end && i < detectorSize; ++i) {
+                            m_badPixels.push_back(i);
+                        }
+                    }
+                }
+
+                std::sort(m_badPixels.begin(), m_badPixels.end());
+                m_badPixels.erase(std::unique(m_badPixels.begin(), m_badPixels.end()), m_badPixels.end());
+                for (const unsigned int i : m_badPixels) {
+                    m_isBadPixel[i] = true;
+                }
+                KARABO_LOG_FRAMEWORK_INFO << "Loaded " << m_badPixels.size() << " bad pixels from " << filename;
+
+            } catch (const std::exception& e) {
+                KARABO_LOG_FRAMEWORK_WARN << "loadBadPixels: " << e.what() << ". No bad pixels will be masked.";
+                m_badPixels.clear();
+                m_isBadPixel.assign(detectorSize, false);
+            }
+        }
+
+        this->set("badPixels.maskedPixels", static_cast<unsigned int>(m_badPixels.size()));
+    }
+
+    void SlsReceiver::maskBadPixels(unsigned short* adc, unsigned char* gain) const {
+        // Only the bad pixels are touched, while the frame is still in cache
+        for (const unsigned int i : m_badPixels) {
+            if (m_zeroBadPixels) {
+                adc[i] = 0;
+                gain[i] = 0;
+            } else {
+                gain[i] = BAD_PIXEL_GAIN;
+            }
+        }
+    }
+
+    const unsigned char* SlsReceiver::getZeroedPixels() const {
+        if (!m_maskEnabled || !m_zeroBadPixels || m_badPixels.empty()) {
+            return nullptr;
+        }
+        return m_isBadPixel.data();
+    }
+
+    const unsigned short* SlsReceiver::interpolateBadPixels(const unsigned short* adc) {
+        const std::vector<unsigned long long> displayShape = this->getDisplayShape();
+        const long long width = displayShape.back();
+        const long long height = (displayShape.size() > 1) ? displayShape[displayShape.size() - 2] : 1;
+        m_displayAdc.assign(adc, adc + width * height);
+
+        // Neighbours in the same row, and in the adjacent ones for 2-dimensional detectors
+        for (const unsigned int i : m_badPixels) {
+            const long long x = i % width;
+            const long long y = i / width;
+            unsigned int sum = 0;
+            unsigned int count = 0;
+            for (long long ny = std::max(y - 1, 0ll); ny <= std::min(y + 1, height - 1); ++ny) {
+                for (long long nx = std::max(x - 1, 0ll); nx <= std::min(x + 1, width - 1); ++nx) {
+                    const size_t n = ny * width + nx;
+                    if (!m_isBadPixel[n]) {
+                        sum += adc[n];
+                        count += 1;
+                    }
+                }
+            }
+            m_displayAdc[i] = (count > 0) ? sum / count : 0;
+        }
+
+        return m_displayAdc.data();
+    }
+
+    void SlsReceiver::encodeFrames(const DetectorData* detectorData) {
+        const size_t detectorSize = this->getDetectorSize();
+        const bool usePedestal = m_pedestal.isValid() && m_pedestal.pixels() == detectorSize;
+        const float threshold = m_encodingThreshold;
+
+        m_encodedFrames.clear();
+        for (size_t frame = 0; frame < detectorData->frameValid.size(); ++frame) {
+            const unsigned short* adc = detectorData->adc + frame * detectorSize;
+            const unsigned char* gain = detectorData->gain + frame * detectorSize;
+            const unsigned char* zeroed = this->getZeroedPixels();
+            const auto hasSignal = [adc, gain, zeroed, usePedestal, threshold, this](size_t i) {
+                if (gain[i] == BAD_PIXEL_GAIN || (zeroed != nullptr && zeroed[i] != 0)) {
+                    return false;
+                } else if (gain[i] != 0) {
+                    return true;
+                }
+                const float pedestal = usePedestal ? m_pedestal.mean(0, i) : 0.f;
+                return adc[i] > pedestal + threshold;
+            };
+            encodeFrame(adc, gain, detectorSize, hasSignal, m_maxOccupancy, m_encodedFrames);
+        }
+    }
+
+    void SlsReceiver::writeChunk(const DetectorData* detectorData, unsigned short firstFrame,
+                                 unsigned short numberOfFrames, const karabo::data::Timestamp& actualTimestamp) {
+
+        const size_t detectorSize = this->getDetectorSize();
+        const size_t framesPerTrain = detectorData->frameValid.size();
+        const size_t offset = detectorSize * firstFrame;
+        const size_t size = detectorSize * numberOfFrames;
+        const size_t lastFrame = firstFrame + numberOfFrames;
+
+        std::vector<unsigned long long> vPPShape = this->getDisplayShape();
+        vPPShape.insert(vPPShape.begin(), numberOfFrames);
+        const Dims ppShape = vPPShape;
+        NDArray adcChunkData(detectorData->adc + offset, size, NDArray::NullDeleter(), ppShape);   // No-copy
+        NDArray gainChunkData(detectorData->gain + offset, size, NDArray::NullDeleter(), ppShape); // No-copy
+
+        const auto slice = [firstFrame, lastFrame](const auto& v) {
+            return std::decay_t<decltype(v)>(v.begin() + firstFrame, v.begin() + lastFrame);
+        };
+
+        Hash output;
+        output.set("data.adc", adcChunkData);
+        output.set("data.gain", gainChunkData);
+        output.set("data.memoryCell", slice(detectorData->memoryCell));
+        output.set("data.frameValid", slice(detectorData->frameValid));
+        output.set("data.frameNumber", slice(detectorData->frameNumber));
+        output.set("data.bunchId", slice(detectorData->bunchId));
+        output.set("data.timestamp", slice(detectorData->timestamp));
+        output.set("data.chunkIndex", static_cast<unsigned short>(firstFrame / m_chunkSize));
+        output.set("data.firstFrame", firstFrame);
+        output.set("data.lastChunk", lastFrame >= framesPerTrain);
+        this->writeChannel("output", output, actualTimestamp);
     }
 } /* namespace karabo */
@@ -9,7 +9,11 @@
 #ifndef KARABO_SLSRECEIVER_HH
 #define KARABO_SLSRECEIVER_HH
 
+#include <atomic>
 #include <boost/interprocess/sync/interprocess_semaphore.hpp>
+#include <chrono>
+#include <functional>
+#include <mutex>
 #include <karabo/karabo.hpp>
 
 #ifndef SLS_SIMULATION
@@ -20,6 +24,10 @@
 #endif
 
 #include "../common/version.hh" // provides SLSDETECTORS_PACKAGE_VERSION
+#include "Affinity.hh"
+#include "Corrections.hh"
+#include "FrameEncoding.hh"
+#include "FrameTiming.hh"
 
 /**
  * The main Karabo namespace
@@ -28,7 +36,8 @@ namespace karabo {
 
     // Detector data (accumulated per train)
     struct DetectorData {
-        DetectorData() : mutex(1), accumulatedFrames(0), size(0), adc(0), gain(0){};
+        DetectorData()
+            : mutex(1), lastFrameTime(0.), accumulatedFrames(0), publishedFrames(0), size(0), adc(0), gain(0){};
 
         ~DetectorData() {
             this->free();
@@ -38,33 +47,37 @@ namespace karabo {
         boost::interprocess::interprocess_semaphore mutex;
 
         karabo::data::Timestamp lastTimestamp;
+        double lastFrameTime; // when the last frame was stored
         unsigned short accumulatedFrames;
+        unsigned short publishedFrames; // already sent in chunks
         size_t size;
         unsigned short* adc;
         unsigned char* gain;
         std::vector<unsigned char> memoryCell;
+        std::vector<unsigned char> frameValid;
         std::vector<unsigned long long> frameNumber;
         std::vector<unsigned long long> bunchId;
         std::vector<double> timestamp;
 
         void free() {
-            if (adc != NULL) {
-                delete[] adc;
-            }
-            if (gain != NULL) {
-                delete[] gain;
-            }
+            freePages(adc, size * sizeof(unsigned short));
+            freePages(gain, size * sizeof(unsigned char));
+            adc = NULL;
+            gain = NULL;
             size = 0;
         }
 
+        // The buffers are placed on the NUMA node of the thread calling reset() first
         void resize(size_t detectorSize, unsigned short framesPerTrain) {
             this->free();
 
-            size = detectorSize * framesPerTrain;
-            adc = new unsigned short[size];
-            gain = new unsigned char[size];
+            const size_t newSize = detectorSize * framesPerTrain;
+            adc = static_cast<unsigned short*>(allocatePages(newSize * sizeof(unsigned short)));
+            gain = static_cast<unsigned char*>(allocatePages(newSize * sizeof(unsigned char)));
+            size = newSize;
 
             memoryCell.resize(framesPerTrain);
+            frameValid.resize(framesPerTrain);
             frameNumber.resize(framesPerTrain);
             bunchId.resize(framesPerTrain);
             timestamp.resize(framesPerTrain);
@@ -72,16 +85,79 @@ namespace karabo {
 
         void reset() {
             accumulatedFrames = 0;
+            publishedFrames = 0;
             std::memset(adc, 0, size * sizeof(unsigned short));
             std::memset(gain, 0, size * sizeof(unsigned char));
             std::memset(memoryCell.data(), 255, memoryCell.size() * sizeof(unsigned char));
+            std::memset(frameValid.data(), 0, frameValid.size() * sizeof(unsigned char));
             std::memset(frameNumber.data(), 0, frameNumber.size() * sizeof(unsigned long long));
             std::memset(bunchId.data(), 0, frameNumber.size() * sizeof(unsigned long long));
             std::memset(timestamp.data(), 0, timestamp.size() * sizeof(double));
         }
 
+        // The NUMA nodes the buffers are actually placed on
+        std::vector<int> getNodes() const {
+            std::vector<int> nodes = getPageNodes(adc, size * sizeof(unsigned short));
+            const std::vector<int> gainNodes = getPageNodes(gain, size * sizeof(unsigned char));
+            nodes.insert(nodes.end(), gainNodes.begin(), gainNodes.end());
+            std::sort(nodes.begin(), nodes.end());
+            nodes.erase(std::unique(nodes.begin(), nodes.end()), nodes.end());
+            return nodes;
+        }
+
         void resetTimestamp(const karabo::data::Timestamp& actualTimestamp) {
             lastTimestamp = actualTimestamp;
+            lastFrameTime = actualTimestamp.toTimestamp();
+        }
+    };
+
+    // A step of the in-receiver processing, with its timing counters
+    struct ProcessingStage {
+        typedef std::function<void(const DetectorData*, const karabo::data::Timestamp&)> Function;
+
+        ProcessingStage(const std::string& name, const Function& process = Function())
+            : name(name), process(process), calls(0), nanoseconds(0){};
+
+        const std::string name;
+        const Function process; // Per-train processing. Empty for the per-frame stages, run in the receiver callback
+
+        // Accumulated since the last publication. Per-frame stages update them from the receiver callback
+        std::atomic<unsigned long long> calls;
+        std::atomic<unsigned long long> nanoseconds;
+
+        bool isFrameStage() const {
+            return !process;
+        }
+
+        void addTime(std::chrono::steady_clock::duration elapsed, unsigned int numberOfCalls = 1) {
+            nanoseconds += std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+            calls += numberOfCalls;
+        }
+
+        void run(const DetectorData* detectorData, const karabo::data::Timestamp& actualTimestamp) {
+            const auto start = std::chrono::steady_clock::now();
+            process(detectorData, actualTimestamp);
+            this->addTime(std::chrono::steady_clock::now() - start);
+        }
+    };
+
+    // Only threads owned by the device are pinned: not the event-loop ones, shared with other devices
+    enum class ThreadRole { callback, worker };
+
+    // CPUs a group of threads is pinned to, and the outcome
+    struct ThreadPlacement {
+        ThreadPlacement() : pinned(0), failed(0){};
+
+        std::vector<int> cpus;
+        std::vector<int> nodes; // NUMA nodes of the CPUs
+        unsigned int pinned;    // threads successfully pinned
+        unsigned int failed;
+
+        void reset(const std::vector<int>& newCpus) {
+            cpus = newCpus;
+            nodes = getCpuNodes(cpus);
+            pinned = 0;
+            failed = 0;
         }
     };
 
@@ -116,6 +192,40 @@ namespace karabo {
 
         void initialize();
 
+       private: // Slots
+        void acquirePedestal();
+
+       protected:
+        // Store the frames in the train buffers
+        static void processRawData(slsDetectorDefs::sls_receiver_header& header,
+                                   const slsDetectorDefs::dataCallbackHeader dataCallbackHeader, char* dataPointer,
+                                   size_t& dataSize, void* context);
+
+        void logWarning(const std::string& message);
+
+        // Add a per-train stage, which can be enabled in "pipeline.stages". To be called in the constructor
+        void registerStage(const std::string& name, const ProcessingStage::Function& process);
+
+        // Pin the calling thread to the CPUs configured for its role (once per acquisition)
+        void placeThread(ThreadRole role);
+
+        // Pedestal subtraction, common-mode correction and gain weighting of one frame of a train
+        void correctFrame(const DetectorData* detectorData, size_t frame, float* corrected);
+
+        /**
+         * Zeroed bad pixels look like valid pixels in gain 0: they must be excluded with this mask.
+         *
+         * @return non-zero for the zeroed bad pixels, null if no pixel is zeroed
+         */
+        const unsigned char* getZeroedPixels() const;
+
+        // Pedestal and relative gains, only to be used in the strand
+        Pedestal m_pedestal;
+        std::vector<double> m_relativeGain;
+
+        // Strand to guarantee that the writing order of DetectorData elements is preserved
+        karabo::net::Strand::Pointer m_strand;
+
        private: // Functions
         static void startAcquisitionCallBack(const slsDetectorDefs::startCallbackHeader, void* context);
 
@@ -125,6 +235,48 @@ namespace karabo {
                                          const slsDetectorDefs::dataCallbackHeader, char* dataPointer, size_t& dataSize,
                                          void* context);
 
+        // Detector specific initialization, e.g. additional sls receivers
+        virtual void initializeDetectorSpecific(){};
+
+        // Detector specific actions at start and end of acquisition
+        virtual void startAcquisitionDetectorSpecific(){};
+        virtual void finishAcquisitionDetectorSpecific(){};
+
+        // Detector specific processing of complete trains, executed in the strand
+        virtual void resetTrainProcessing(){};
+        virtual void flushTrainProcessing(){};
+
+        // End-of-stream on the detector specific output channels, after flushTrainProcessing
+        virtual void signalEndOfStreamsDetectorSpecific(){};
+
+        /**
+         * The base implementation returns 0, i.e. the common mode is estimated over the whole detector.
+         * May be overridden in derived classes, to group the pixels sharing the same common mode (e.g. per chip).
+         *
+         * @param pixel
+         * @return the common-mode group of the pixel
+         */
+        virtual unsigned int getCommonModeGroup(size_t pixel) {
+            return 0;
+        }
+
+        void applyCommonMode(const unsigned char* gain, const unsigned char* excluded, float* corrected);
+
+        // Bad pixels, flagged or zeroed after unpacking
+        void loadBadPixels();
+        void maskBadPixels(unsigned short* adc, unsigned char* gain) const;
+        const unsigned short* interpolateBadPixels(const unsigned short* adc);
+
+        /**
+         * The base implementation directly processes the raw data.
+         * May be overridden in derived classes, e.g. to combine them with data from another sls receiver.
+         */
+        virtual void onRawData(slsDetectorDefs::sls_receiver_header& header,
+                               const slsDetectorDefs::dataCallbackHeader dataCallbackHeader, char* dataPointer,
+                               size_t& dataSize) {
+            processRawData(header, dataCallbackHeader, dataPointer, dataSize, static_cast<SlsReceiver*>(this));
+        }
+
         /**
          * The base implementation returns true if meta("trainId") is incremented w.r.t. meta("lastTrainId").
          * May be overridden in derived classes for specific behavior.
@@ -138,16 +290,69 @@ namespace karabo {
             return 255;
         }
 
-        void logWarning(const std::string& message);
+        /**
+         * The base implementation returns -1, meaning that frames are stored in the train buffer in arrival order.
+         * May be overridden in derived classes, to store each frame at a given position (e.g. the one of its
+         * memory cell).
+         *
+         * @param memoryCell
+         * @return the position of the frame in the train buffer, or -1
+         */
+        virtual int getFrameSlot(unsigned char memoryCell) {
+            return -1;
+        }
+
+        // Get the timestamp, with trainId derived from the frame number
+        karabo::data::Timestamp getFrameNumberTimestamp(unsigned long long frameNumber,
+                                                        const karabo::data::Epochstamp& epochstamp);
+
+        // Get the epochstamp from the detector clock, calibrating it if needed
+        karabo::data::Epochstamp getDetectorClockEpochstamp(const slsDetectorDefs::sls_detector_header& detectorHeader);
 
         // Make output schema fit for DAQ
-        void updateOutputSchema(unsigned short framesPerTrain);
+        void updateOutputSchema(unsigned short framesPerTrain, bool daqEncoding);
 
         // Send End-of-Stream signal
         void signalEndOfStreams();
 
+        // Train reorder window
+        void openTrain(const karabo::data::Timestamp& actualTimestamp);
+        void flushOldestTrain();
+        void flushExpiredTrains(double currentTime);
+        DetectorData* findOpenTrain(unsigned long long trainId);
+
+        // Flush the expired trains also when no frame arrives: armed while trains are open
+        void scheduleTrainFlush();
+        void onTrainFlushTimer(const boost::system::error_code& ec);
+        void checkExpiredTrains();
+
+        // Post the complete chunks of a train, for writing to the PP output channel
+        void postChunks(DetectorData* detectorData);
+
+        // Train processing, executed in the strand
+        void startPedestal(unsigned int frames);
+        void startTrainProcessing();
+        void accumulatePedestal(const DetectorData* detectorData, const karabo::data::Timestamp& actualTimestamp);
+        void processMeanImage(const DetectorData* detectorData, const karabo::data::Timestamp& actualTimestamp);
+
+        // Thread and buffer placement
+        void startPlacement();
+        std::string formatPlacement() const;
+
+        // Processing pipeline
+        ProcessingStage* findStage(const std::string& name) const;
+        void validatePipeline(const std::vector<std::string>& stages) const;
+        void publishStageTimes();
+
+        // Run the pipeline on a complete train, then release its buffer
+        void writeToOutputs(unsigned short idx, const karabo::data::Timestamp& actualTimestamp);
+
         // Write to OUTPUT channels
-        void writeToOutputs(unsigned char idx, const karabo::data::Timestamp& actualTimestamp);
+        void publishTrain(const DetectorData* detectorData, const karabo::data::Timestamp& actualTimestamp);
+        void compressTrain(const DetectorData* detectorData, const karabo::data::Timestamp& actualTimestamp);
+        void writeChunk(const DetectorData* detectorData, unsigned short firstFrame, unsigned short numberOfFrames,
+                        const karabo::data::Timestamp& actualTimestamp);
+        void encodeFrames(const DetectorData* detectorData);
 
        private: // Raw data unpacking
         virtual size_t getDetectorSize() = 0;
@@ -164,13 +369,85 @@ namespace karabo {
         unsigned long long m_lastFrameNum;
         double m_lastRateTime;
 
-        // Detector data (accumulated per train)
-        // Use one for receiving data, the other one for writing to output channels
-        unsigned char m_detectorDataIdx;
-        DetectorData m_detectorData[2];
-
-        // Strand to guarantee that the writing order of DetectorData elements is preserved
-        karabo::net::Strand::Pointer m_strand;
+        // Detector data (accumulated per train), used as a ring buffer.
+        // The last m_openTrains ones (up to m_detectorDataIdx) are receiving data, the others can be written
+        // to output channels
+        unsigned short m_detectorDataIdx;
+        unsigned short m_openTrains;
+        std::vector<std::unique_ptr<DetectorData>> m_detectorData;
+
+        // Reorder window: number of trains receiving data, and counters
+        unsigned short m_reorderWindow;
+        double m_reorderTimeout;
+        unsigned long long m_lateFrames;
+        unsigned long long m_misplacedFrames;
+
+        // Protects the reorder window, shared by the receiver callback and the flush timer (in m_strand)
+        std::mutex m_trainMutex;
+        boost::asio::deadline_timer m_trainFlushTimer;
+        bool m_trainFlushArmed;
+
+        // Mapping from frame number to trainId
+        FrameNumberMapping m_frameNumberMapping;
+
+        // Detector clock, for frame timestamps
+        DetectorClock m_detectorClock;
+
+        // Number of frames per message on the PP output channel (0: whole train)
+        unsigned short m_chunkSize;
+
+        // Frames still to be accumulated in the pedestal
+        unsigned int m_pedestalFramesLeft;
+
+        // Bad pixels, loaded at the start of the acquisition
+        std::vector<unsigned int> m_badPixels;
+        std::vector<unsigned char> m_isBadPixel;
+        bool m_zeroBadPixels;
+        std::vector<unsigned short> m_displayAdc;
+
+        // Common-mode correction, only to be used in the strand
+        bool m_commonMode;
+        bool m_commonModeMedian;
+        float m_commonModeThreshold;
+        std::vector<unsigned int> m_commonModeGroup; // per pixel
+        std::vector<float> m_commonModeEstimate;     // per group
+        std::vector<double> m_commonModeSum;
+        std::vector<unsigned int> m_commonModeCount;
+        std::vector<std::vector<float>> m_commonModeValues;
+
+        // Train-averaged image, and its moving average across trains, only to be used in the strand
+        // Integer sums are exact, and allow computing the std without cancellation errors
+        std::vector<unsigned long long> m_imageSum;
+        std::vector<unsigned long long> m_imageSum2;
+        std::vector<unsigned int> m_imageCount; // Frames per pixel, as bad pixels are skipped
+        std::vector<float> m_imageMean;
+        std::vector<float> m_imageStd;
+        std::vector<float> m_imageAverage;
+        double m_lastAverageTime;
+        double m_lastMeanImageTime;
+
+        // Sparse/dense encoding of the frames for the DAQ, only to be used in the strand
+        bool m_daqEncoding;
+        unsigned short m_encodingThreshold;
+        float m_maxOccupancy;
+        EncodedFrames m_encodedFrames;
+        bool m_framesEncoded; // m_encodedFrames hold the train being published
+
+        // Processing stages. All the available ones, the enabled per-train ones in execution order (only to be
+        // used in the strand), and all the enabled ones in configuration order, for the timing
+        std::vector<std::unique_ptr<ProcessingStage>> m_stages;
+        std::vector<ProcessingStage*> m_pipeline;
+        std::vector<ProcessingStage*> m_timedStages;
+        ProcessingStage* m_unpackStage;
+        ProcessingStage* m_maskStage;
+        bool m_maskEnabled;
+        double m_lastStageTimesTime;
+
+        // Thread placement per role, and where the train buffers were first touched
+        mutable std::mutex m_placementMutex;
+        ThreadPlacement m_placement[2];
+        std::vector<int> m_bufferNodes;
+        std::atomic<unsigned int> m_acquisitionNumber; // Threads are placed again at every acquisition
 
         // For rate calculation
         long long m_frameCount;
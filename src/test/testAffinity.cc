@@ -0,0 +1,39 @@
+/*
+ * Copyright (c) European XFEL GmbH Schenefeld. All rights reserved.
+ */
+
+#include <gtest/gtest.h>
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../slsReceiver/Affinity.hh"
+
+
+TEST(AffinityTest, testParseCpuList) {
+    ASSERT_EQ(karabo::parseCpuList(""), std::vector<int>());
+    ASSERT_EQ(karabo::parseCpuList("5"), std::vector<int>({5}));
+    ASSERT_EQ(karabo::parseCpuList("0-3,8,10-11"), std::vector<int>({0, 1, 2, 3, 8, 10, 11}));
+
+    // Spaces and empty entries are ignored, the CPUs are sorted and without duplicates
+    ASSERT_EQ(karabo::parseCpuList(" 8, 2-3 ,,1-2 "), std::vector<int>({1, 2, 3, 8}));
+    ASSERT_EQ(karabo::parseCpuList("4-4"), std::vector<int>({4}));
+}
+
+TEST(AffinityTest, testParseMalformedCpuList) {
+    for (const std::string cpuList : {"a", "1,b", "1x", "1-", "-1", "1-2-3", "2-1", "0-99999", "1.5"}) {
+        ASSERT_THROW(karabo::parseCpuList(cpuList), std::invalid_argument) << "CPU list '" << cpuList << "'";
+    }
+}
+
+TEST(AffinityTest, testFormatCpuList) {
+    ASSERT_EQ(karabo::formatCpuList({}), "");
+    ASSERT_EQ(karabo::formatCpuList({5}), "5");
+    ASSERT_EQ(karabo::formatCpuList({0, 1, 2, 3, 8, 10, 11}), "0-3,8,10-11");
+    ASSERT_EQ(karabo::formatCpuList({1, 3, 5}), "1,3,5");
+
+    // Round trip
+    const std::string cpuList("0-7,16-23,31");
+    ASSERT_EQ(karabo::formatCpuList(karabo::parseCpuList(cpuList)), cpuList);
+}
@@ -0,0 +1,73 @@
+/*
+ * Copyright (c) European XFEL GmbH Schenefeld. All rights reserved.
+ */
+
+#include <gtest/gtest.h>
+
+#include <string>
+#include <vector>
+
+#include "../slsControl/ConfigurationShadow.hh"
+
+
+TEST(ConfigurationShadowTest, testIsApplied) {
+    karabo::ConfigurationShadow shadow({"findex"});
+    ASSERT_FALSE(shadow.isApplied("exptime", "10us", -1));
+
+    shadow.update({"exptime 10us", "findex 0"}, true, 2);
+    ASSERT_TRUE(shadow.isApplied("exptime", "10us", -1));
+    ASSERT_FALSE(shadow.isApplied("exptime", "20us", -1));
+    ASSERT_FALSE(shadow.isApplied("findex", "0", -1)); // Always sent
+    ASSERT_EQ(shadow.getAppliedCommands(), std::vector<std::string>({"exptime 10us"}));
+
+    // Values not known to be applied are forgotten
+    shadow.update({"exptime 20us"}, false, 2);
+    ASSERT_FALSE(shadow.isApplied("exptime", "10us", -1));
+    ASSERT_FALSE(shadow.isApplied("exptime", "20us", -1));
+    ASSERT_TRUE(shadow.getAppliedCommands().empty());
+}
+
+TEST(ConfigurationShadowTest, testModuleFallback) {
+    karabo::ConfigurationShadow shadow({"findex"});
+
+    // Modules without their own value fall back to the one sent to all modules
+    shadow.update({"vhighvoltage 120"}, true, 2);
+    ASSERT_TRUE(shadow.isApplied("vhighvoltage", "120", 0));
+    ASSERT_TRUE(shadow.isApplied("vhighvoltage", "120", 1));
+
+    // A module value replaces the one for all modules
+    shadow.update({"1:vhighvoltage 150"}, true, 2);
+    ASSERT_TRUE(shadow.isApplied("vhighvoltage", "150", 1));
+    ASSERT_FALSE(shadow.isApplied("vhighvoltage", "120", 1));
+    ASSERT_FALSE(shadow.isApplied("vhighvoltage", "120", -1));
+    ASSERT_FALSE(shadow.isApplied("vhighvoltage", "120", 0));
+    ASSERT_EQ(shadow.getAppliedCommands(), std::vector<std::string>({"vhighvoltage 120", "1:vhighvoltage 150"}));
+
+    // And the value for all modules replaces the module ones
+    shadow.update({"0:vhighvoltage 90", "vhighvoltage 200"}, true, 2);
+    ASSERT_TRUE(shadow.isApplied("vhighvoltage", "200", 0));
+    ASSERT_TRUE(shadow.isApplied("vhighvoltage", "200", 1));
+    ASSERT_FALSE(shadow.isApplied("vhighvoltage", "150", 1));
+
+    // Only the last value of each command is journaled
+    ASSERT_EQ(shadow.getAppliedCommands(),
+              std::vector<std::string>({"1:vhighvoltage 150", "0:vhighvoltage 90", "vhighvoltage 200"}));
+}
+
+TEST(ConfigurationShadowTest, testClear) {
+    karabo::ConfigurationShadow shadow({});
+    shadow.update({"exptime 10us", "0:dac vb_comp 1220"}, true, 1);
+    ASSERT_TRUE(shadow.isApplied("dac", "vb_comp 1220", 0));
+
+    // The detector reloads its defaults
+    shadow.update({"settings gain0"}, true, 1);
+    ASSERT_FALSE(shadow.isApplied("exptime", "10us", -1));
+    ASSERT_FALSE(shadow.isApplied("dac", "vb_comp 1220", 0));
+    ASSERT_TRUE(shadow.isApplied("settings", "gain0", -1));
+
+    shadow.clear();
+    ASSERT_FALSE(shadow.isApplied("settings", "gain0", -1));
+    ASSERT_FALSE(shadow.getAppliedCommands().empty()); // Only the values are forgotten
+    shadow.clearAppliedCommands();
+    ASSERT_TRUE(shadow.getAppliedCommands().empty());
+}
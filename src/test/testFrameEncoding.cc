@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) European XFEL GmbH Schenefeld. All rights reserved.
+ */
+
+#include <gtest/gtest.h>
+
+#include <vector>
+
+#include "../slsReceiver/FrameEncoding.hh"
+
+#define TEST_FRAME_SIZE 100
+
+
+TEST(FrameEncodingTest, testSparseAndDense) {
+    // First frame with 2 pixels above threshold, second one with all of them
+    std::vector<unsigned short> adc(2 * TEST_FRAME_SIZE, 10);
+    std::vector<unsigned char> gain(2 * TEST_FRAME_SIZE, 0);
+    adc[3] = 500;
+    adc[42] = 700;
+    gain[42] = 1;
+    for (size_t i = TEST_FRAME_SIZE; i < 2 * TEST_FRAME_SIZE; ++i) {
+        adc[i] = 1000 + i;
+    }
+
+    karabo::EncodedFrames encoded;
+    for (size_t frame = 0; frame < 2; ++frame) {
+        const unsigned short* frameAdc = adc.data() + frame * TEST_FRAME_SIZE;
+        const unsigned char* frameGain = gain.data() + frame * TEST_FRAME_SIZE;
+        const auto hasSignal = [frameAdc](size_t i) { return frameAdc[i] > 100; };
+        karabo::encodeFrame(frameAdc, frameGain, TEST_FRAME_SIZE, hasSignal, 0.1f, encoded);
+    }
+
+    ASSERT_EQ(encoded.encoding, std::vector<unsigned char>({karabo::SPARSE, karabo::DENSE}));
+    ASSERT_EQ(encoded.pixelCount, std::vector<unsigned int>({2, TEST_FRAME_SIZE}));
+    ASSERT_EQ(encoded.index, std::vector<unsigned int>({3, 42}));
+    ASSERT_EQ(encoded.adc.size(), 2u + TEST_FRAME_SIZE);
+
+    // Decoding: pixels below threshold are lost in sparse frames
+    karabo::FrameDecoder decoder(encoded, TEST_FRAME_SIZE);
+    ASSERT_EQ(decoder.frames(), 2u);
+
+    std::vector<unsigned short> decodedAdc(TEST_FRAME_SIZE);
+    std::vector<unsigned char> decodedGain(TEST_FRAME_SIZE);
+    decoder.decode(0, decodedAdc.data(), decodedGain.data());
+    for (size_t i = 0; i < TEST_FRAME_SIZE; ++i) {
+        const unsigned short expectedAdc = (i == 3 || i == 42) ? adc[i] : 0;
+        ASSERT_EQ(decodedAdc[i], expectedAdc) << "pixel " << i;
+        ASSERT_EQ(decodedGain[i], gain[i]) << "pixel " << i;
+    }
+
+    decoder.decode(1, decodedAdc.data(), decodedGain.data());
+    for (size_t i = 0; i < TEST_FRAME_SIZE; ++i) {
+        ASSERT_EQ(decodedAdc[i], adc[TEST_FRAME_SIZE + i]) << "pixel " << i;
+    }
+}
+
+TEST(FrameEncodingTest, testInconsistentFrames) {
+    karabo::EncodedFrames encoded;
+    encoded.encoding.push_back(karabo::SPARSE);
+    encoded.pixelCount.push_back(1);
+
+    ASSERT_THROW(karabo::FrameDecoder(encoded, TEST_FRAME_SIZE), std::invalid_argument);
+}
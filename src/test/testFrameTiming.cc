@@ -0,0 +1,110 @@
+/*
+ * Copyright (c) European XFEL GmbH Schenefeld. All rights reserved.
+ */
+
+#include <gtest/gtest.h>
+
+#include "../slsReceiver/FrameTiming.hh"
+
+
+TEST(FrameTimingTest, testFrameNumberMapping) {
+    karabo::FrameNumberMapping mapping;
+    mapping.frameNumbersPerTrain = 10;
+    mapping.anchorFrameNumber = 1000;
+    mapping.anchorTrainId = 50;
+
+    ASSERT_EQ(mapping.getTrainId(1000), 50u);
+    ASSERT_EQ(mapping.getTrainId(1009), 50u);
+    ASSERT_EQ(mapping.getTrainId(1010), 51u);
+    ASSERT_EQ(mapping.getTrainId(1234), 73u);
+
+    // Frames preceding the anchor belong to earlier trains
+    ASSERT_EQ(mapping.getTrainId(999), 49u);
+    ASSERT_EQ(mapping.getTrainId(990), 49u);
+    ASSERT_EQ(mapping.getTrainId(989), 48u);
+
+    // One frame per train
+    mapping.frameNumbersPerTrain = 1;
+    ASSERT_EQ(mapping.getTrainId(1000), 50u);
+    ASSERT_EQ(mapping.getTrainId(1001), 51u);
+    ASSERT_EQ(mapping.getTrainId(998), 48u);
+}
+
+TEST(FrameTimingTest, testDetectorClock) {
+    karabo::DetectorClock clock;
+    clock.calibrationInterval = 10.;
+    ASSERT_TRUE(clock.needsCalibration(0));
+
+    // Anchored at the first calibration: 10^7 ticks per second
+    clock.calibrate(1000000000ull, 1000.);
+    ASSERT_DOUBLE_EQ(clock.toTime(1000000000.), 1000.);
+    ASSERT_DOUBLE_EQ(clock.toTime(1005000000.), 1000.5);
+    ASSERT_FALSE(clock.needsCalibration(1050000000ull));
+    ASSERT_TRUE(clock.needsCalibration(1100000001ull));
+
+    // The host clock ran 10 ppm faster over 10 s: no jump, the offset is absorbed over the next intervals
+    clock.calibrate(1100000000ull, 1010.0001);
+    ASSERT_NEAR(clock.baseRate, 1.00001, 1.e-12);
+    ASSERT_NEAR(clock.offset, 0.0001, 1.e-9);
+    ASSERT_NEAR(clock.toTime(1100000000.), 1010., 1.e-9);
+    ASSERT_NEAR(clock.rate, 1.00001 + 0.0001 / 40., 1.e-12);
+    ASSERT_NEAR(clock.toTime(1200000000.), 1020.000125, 1.e-9);
+
+    // Late frames, preceding the last calibration, do not trigger a new one
+    ASSERT_FALSE(clock.needsCalibration(1099999999ull));
+}
+
+TEST(FrameTimingTest, testDetectorClockContinuity) {
+    karabo::DetectorClock clock;
+    clock.calibrationInterval = 10.;
+    clock.calibrate(0ull, 1000.);
+
+    // Host clock 10 ppm faster, with 1 ms of jitter on the calibrations
+    double offset = 0.;
+    for (int i = 1; i <= 30; ++i) {
+        const uint64_t ticks = i * 100000000ull;
+        const double before = clock.toTime(ticks);
+        clock.calibrate(ticks, 1000. + i * 10. * 1.00001 + ((i % 2) ? 0.001 : -0.001));
+        ASSERT_NEAR(clock.toTime(ticks), before, 1.e-9) << "Calibration " << i;
+        offset = clock.offset;
+    }
+    // Within the jitter over the baseline, and what is left of the offset is the jitter
+    ASSERT_NEAR(clock.baseRate, 1.00001, 0.001 / 300.);
+    ASSERT_LT(std::abs(offset), 0.002);
+}
+
+TEST(FrameTimingTest, testDetectorClockWrapAround) {
+    karabo::DetectorClock clock;
+    clock.calibrationInterval = 10.;
+    clock.calibrate(1000000000ull, 1000.);
+    clock.calibrate(1100000000ull, 1010.0001);
+
+    // The detector clock went back (reset, or counter wrap-around): anchored again
+    ASSERT_TRUE(clock.needsCalibration(500ull));
+    clock.calibrate(500ull, 2000.);
+    ASSERT_DOUBLE_EQ(clock.baseRate, 1.);
+    ASSERT_DOUBLE_EQ(clock.rate, 1.);
+    ASSERT_DOUBLE_EQ(clock.offset, 0.);
+    ASSERT_DOUBLE_EQ(clock.toTime(500.), 2000.);
+    ASSERT_DOUBLE_EQ(clock.toTime(10000500.), 2001.);
+    ASSERT_FALSE(clock.needsCalibration(10000500ull));
+
+    clock.reset();
+    ASSERT_TRUE(clock.needsCalibration(10000500ull));
+}
+
+TEST(FrameTimingTest, testDetectorClockFrameSpacing) {
+    karabo::DetectorClock clock;
+    clock.update(1000, 1);
+    ASSERT_DOUBLE_EQ(clock.ticksPerFrame, 0.);
+
+    // 4 frames in 1000 ticks
+    clock.update(2000, 5);
+    ASSERT_DOUBLE_EQ(clock.ticksPerFrame, 250.);
+
+    // Not updated by out-of-order frames, nor by a clock going back
+    clock.update(1500, 3);
+    ASSERT_DOUBLE_EQ(clock.ticksPerFrame, 250.);
+    clock.update(100, 10);
+    ASSERT_DOUBLE_EQ(clock.ticksPerFrame, 250.);
+}